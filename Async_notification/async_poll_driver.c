@@ -25,6 +25,8 @@ Create device file
 #include <linux/sched/signal.h>
 #include <linux/fcntl.h>
 
+#include "chardev_stats.h"
+
 #define DEVICE_NAME "asyncpoll"
 #define CLASS_NAME "asyncpollclass"
 #define BUFFER_SIZE 1024
@@ -37,6 +39,7 @@ static char device_buffer[BUFFER_SIZE];
 static int buffer_has_data = 0;
 
 static struct fasync_struct *async_queue;
+static struct chardev_stats stats;
 
 static ssize_t my_read(struct file *f, char __user *buf, size_t len, loff_t *off) {
     if (!buffer_has_data)
@@ -67,6 +70,23 @@ static ssize_t my_write(struct file *f, const char __user *buf, size_t len, loff
     return len;
 }
 
+// Entry points: account every call in the per-CPU stats
+static ssize_t my_stat_read(struct file *f, char __user *buf, size_t len, loff_t *off) {
+    u64 start = ktime_get_ns();
+    ssize_t ret = my_read(f, buf, len, off);
+
+    chardev_stats_record(&stats, CHARDEV_OP_READ, ret, start);
+    return ret;
+}
+
+static ssize_t my_stat_write(struct file *f, const char __user *buf, size_t len, loff_t *off) {
+    u64 start = ktime_get_ns();
+    ssize_t ret = my_write(f, buf, len, off);
+
+    chardev_stats_record(&stats, CHARDEV_OP_WRITE, ret, start);
+    return ret;
+}
+
 static unsigned int my_poll(struct file *f, poll_table *wait) {
     poll_wait(f, &wq, wait);
     return buffer_has_data ? POLLIN | POLLRDNORM : 0;
@@ -87,8 +107,8 @@ static int my_fasync(int fd, struct file *f, int mode) {
 
 static struct file_operations fops = {
     .owner = THIS_MODULE,
-    .read = my_read,
-    .write = my_write,
+    .read = my_stat_read,
+    .write = my_stat_write,
     .poll = my_poll,
     .open = my_open,
     .release = my_release,
@@ -96,6 +116,9 @@ static struct file_operations fops = {
 };
 
 static int __init my_init(void) {
+    if (chardev_stats_init(&stats, DEVICE_NAME))
+        return -ENOMEM;
+
     alloc_chrdev_region(&dev_num, 0, 1, DEVICE_NAME);
     cdev_init(&cdev, &fops);
     cdev_add(&cdev, dev_num, 1);
@@ -110,6 +133,7 @@ static void __exit my_exit(void) {
     class_destroy(cl);
     cdev_del(&cdev);
     unregister_chrdev_region(dev_num, 1);
+    chardev_stats_exit(&stats);
     printk(KERN_INFO "AsyncPoll: Module unloaded\n");
 }
 
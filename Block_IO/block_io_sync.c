@@ -33,6 +33,8 @@ Expected output:
 #include <linux/completion.h>
 #include <linux/semaphore.h>
 
+#include "chardev_stats.h"
+
 #define DEVICE_NAME "blockio"
 #define CLASS_NAME  "blockio_class"
 #define BUF_SIZE    128
@@ -47,6 +49,7 @@ static int data_available = 0;
 
 static DECLARE_WAIT_QUEUE_HEAD(read_wq);
 static struct semaphore rw_sem;
+static struct chardev_stats stats;
 
 ssize_t blockio_read(struct file *file, char __user *buf, size_t count, loff_t *ppos);
 ssize_t blockio_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos);
@@ -101,10 +104,29 @@ ssize_t blockio_write(struct file *file, const char __user *buf, size_t count, l
     return count;
 }
 
+// Entry points: account every call (including time spent blocked) in the per-CPU stats
+static ssize_t blockio_stat_read(struct file *file, char __user *buf, size_t count, loff_t *ppos)
+{
+    u64 start = ktime_get_ns();
+    ssize_t ret = blockio_read(file, buf, count, ppos);
+
+    chardev_stats_record(&stats, CHARDEV_OP_READ, ret, start);
+    return ret;
+}
+
+static ssize_t blockio_stat_write(struct file *file, const char __user *buf, size_t count, loff_t *ppos)
+{
+    u64 start = ktime_get_ns();
+    ssize_t ret = blockio_write(file, buf, count, ppos);
+
+    chardev_stats_record(&stats, CHARDEV_OP_WRITE, ret, start);
+    return ret;
+}
+
 static struct file_operations fops = {
     .owner = THIS_MODULE,
-    .read = blockio_read,
-    .write = blockio_write
+    .read = blockio_stat_read,
+    .write = blockio_stat_write
 };
 
 static int __init blockio_init(void)
@@ -112,6 +134,9 @@ static int __init blockio_init(void)
     dev_t dev;
     sema_init(&rw_sem, 1);
 
+    if (chardev_stats_init(&stats, DEVICE_NAME))
+        return -ENOMEM;
+
     alloc_chrdev_region(&dev, 0, 1, DEVICE_NAME);
     major = MAJOR(dev);
 
@@ -131,6 +156,7 @@ static void __exit blockio_exit(void)
     class_destroy(blockio_class);
     unregister_chrdev_region(MKDEV(major, 0), 1);
     cdev_del(&blockio_cdev);
+    chardev_stats_exit(&stats);
     printk(KERN_INFO "Block IO sync driver unloaded\n");
 }
 
@@ -29,16 +29,10 @@ Similar to wait_event_interruptible, but wakes only one process when the conditi
 #include <linux/cdev.h>
 #include <linux/sched.h>
 
+#include "uapi/chardev_ioctl.h"
+
 #define DEVICE_NAME "wait_demo"
 #define CLASS_NAME "wait_demo_class"
-#define MAGIC 'x'
-
-#define IOCTL_DOWN_INTERRUPTIBLE _IO(MAGIC, 1)
-#define IOCTL_WAIT_COMPLETION    _IO(MAGIC, 2)
-#define IOCTL_COMPLETE           _IO(MAGIC, 3)
-#define IOCTL_WAIT_EVENT         _IO(MAGIC, 4)
-#define IOCTL_WAKE_EVENT         _IO(MAGIC, 5)
-#define IOCTL_WAIT_EVENT_EXCL    _IO(MAGIC, 6)
 
 static int major;
 static struct class *wait_class;
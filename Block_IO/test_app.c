@@ -4,17 +4,10 @@
 #include <sys/ioctl.h>
 #include <unistd.h>
 #include <string.h>
+#include "../include/uapi/chardev_ioctl.h"
 
 #define DEVICE "/dev/wait_demo"
 
-#define MAGIC 'x'
-#define IOCTL_DOWN_INTERRUPTIBLE _IO(MAGIC, 1)
-#define IOCTL_WAIT_COMPLETION    _IO(MAGIC, 2)
-#define IOCTL_COMPLETE           _IO(MAGIC, 3)
-#define IOCTL_WAIT_EVENT         _IO(MAGIC, 4)
-#define IOCTL_WAKE_EVENT         _IO(MAGIC, 5)
-#define IOCTL_WAIT_EVENT_EXCL    _IO(MAGIC, 6)
-
 int main(int argc, char *argv[]) {
     int fd;
 
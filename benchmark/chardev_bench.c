@@ -0,0 +1,362 @@
+/* Multi-threaded throughput / latency load generator for the char devices in this repo
+
+Runs N threads against one /dev node for a fixed duration. Every thread opens
+its own file descriptor, can be pinned to a CPU, and picks each operation from
+a weighted mix of read / write / ioctl / lseek. Reads and writes are
+positional (pread/pwrite) at random size-aligned offsets inside -r bytes, so
+threads do not fight over a shared f_pos.
+
+Reports ops/s, GB/s and p50 / p99 / p99.9 / max latency per operation type
+(plus an "all" row) as CSV or JSON, so runs of two module versions can be diffed.
+
+Build: make            (or: gcc -O2 -pthread -o chardev_bench chardev_bench.c)
+
+Examples:
+    ./chardev_bench -d /dev/dynamic_char_dev0 -t 8 -p -m read=80,write=20 -s 4096 -D 10
+    ./chardev_bench -d /dev/dynamic_ioctl_dev -t 4 -m read=50,ioctl=50 -I 0x80044404 -r 1024 -s 64
+    ./chardev_bench -d /dev/mutex_demo -t 16 -m read=90,write=10 -s 100 -r 100 -o json
+
+Options:
+    -d path     device node (required)
+    -t N        threads (default 1)
+    -p          pin thread i to the i-th CPU of the allowed set
+    -m mix      weights, e.g. read=70,write=20,ioctl=5,lseek=5 (default read=100)
+    -s sizes    transfer sizes, comma separated; each op picks one at random (default 4096)
+    -r bytes    offset span for pread/pwrite/lseek (default 1 MiB)
+    -I cmd      ioctl request number for the ioctl op (hex ok); arg is a pointer to an int
+    -a value    initial value of that int (default 0)
+    -D secs     duration (default 5)
+    -o fmt      csv (default) or json
+    -H          omit the CSV header line
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+enum op { OP_READ, OP_WRITE, OP_IOCTL, OP_LSEEK, OP_MAX };
+static const char *op_names[OP_MAX] = { "read", "write", "ioctl", "lseek" };
+
+/*
+ * Log-linear latency histogram: 16 sub-buckets per power of two, i.e. at most
+ * ~6% error on any percentile, with fixed memory and no allocation per sample.
+ */
+#define SUB_BITS    4
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define HIST_SIZE   (64 * SUB_BUCKETS)
+
+struct op_stats {
+    uint64_t ops;
+    uint64_t bytes;
+    uint64_t errors;
+    uint64_t max_ns;
+    uint64_t hist[HIST_SIZE];
+};
+
+struct worker {
+    pthread_t tid;
+    int index;
+    int cpu;
+    uint64_t rng;
+    struct op_stats stats[OP_MAX];
+} __attribute__((aligned(64)));
+
+static const char *device;
+static int nthreads = 1, pin;
+static unsigned int weights[OP_MAX] = { 100, 0, 0, 0 };
+static unsigned int weight_total = 100;
+static size_t *sizes, nsizes, max_size;
+static uint64_t span = 1 << 20;
+static unsigned long ioctl_cmd;
+static int ioctl_arg;
+static double duration = 5;
+static int json, no_header;
+static volatile int stop;
+static pthread_barrier_t start_barrier;
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline uint64_t xorshift(uint64_t *s) {
+    *s ^= *s << 13;
+    *s ^= *s >> 7;
+    *s ^= *s << 17;
+    return *s;
+}
+
+static inline unsigned int hist_index(uint64_t ns) {
+    unsigned int msb;
+
+    if (ns < SUB_BUCKETS)
+        return ns;
+    msb = 63 - __builtin_clzll(ns);
+    return ((msb - SUB_BITS + 1) << SUB_BITS) | ((ns >> (msb - SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+// Lower bound of the values that land in bucket @i
+static uint64_t hist_value(unsigned int i) {
+    unsigned int exp = i >> SUB_BITS, sub = i & (SUB_BUCKETS - 1);
+
+    if (!exp)
+        return sub;
+    return (uint64_t)(SUB_BUCKETS | sub) << (exp - 1);
+}
+
+static uint64_t percentile(const struct op_stats *s, double p) {
+    uint64_t target = (uint64_t)(s->ops * p), seen = 0;
+
+    for (unsigned int i = 0; i < HIST_SIZE; i++) {
+        seen += s->hist[i];
+        if (seen > target)
+            return hist_value(i);
+    }
+    return s->max_ns;
+}
+
+static void record(struct op_stats *s, uint64_t ns, ssize_t ret) {
+    s->ops++;
+    if (ret < 0)
+        s->errors++;
+    else
+        s->bytes += ret;
+    if (ns > s->max_ns)
+        s->max_ns = ns;
+    s->hist[hist_index(ns)]++;
+}
+
+static void merge(struct op_stats *dst, const struct op_stats *src) {
+    dst->ops += src->ops;
+    dst->bytes += src->bytes;
+    dst->errors += src->errors;
+    if (src->max_ns > dst->max_ns)
+        dst->max_ns = src->max_ns;
+    for (int b = 0; b < HIST_SIZE; b++)
+        dst->hist[b] += src->hist[b];
+}
+
+static enum op pick_op(struct worker *w) {
+    unsigned int r = xorshift(&w->rng) % weight_total;
+
+    for (int op = 0; op < OP_MAX; op++) {
+        if (r < weights[op])
+            return op;
+        r -= weights[op];
+    }
+    return OP_READ;
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    char *buf;
+    int fd, iarg = ioctl_arg;
+
+    if (pin) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+            fprintf(stderr, "thread %d: cannot pin to CPU %d\n", w->index, w->cpu);
+    }
+
+    // Allocate after pinning so first touch puts the buffer on the local node
+    buf = aligned_alloc(4096, (max_size + 4095) & ~4095UL);
+    fd = open(device, O_RDWR);
+    if (!buf || fd < 0) {
+        perror(device);
+        exit(1);
+    }
+    memset(buf, 'a' + w->index % 26, max_size);
+
+    pthread_barrier_wait(&start_barrier);
+    while (!stop) {
+        enum op op = pick_op(w);
+        size_t len = sizes[xorshift(&w->rng) % nsizes];
+        off_t off = span > len ? (xorshift(&w->rng) % (span - len + 1)) / len * len : 0;
+        uint64_t t0 = now_ns();
+        ssize_t ret;
+
+        switch (op) {
+        case OP_READ:
+            ret = pread(fd, buf, len, off);
+            break;
+        case OP_WRITE:
+            ret = pwrite(fd, buf, len, off);
+            break;
+        case OP_IOCTL:
+            ret = ioctl(fd, ioctl_cmd, &iarg) < 0 ? -1 : 0;
+            break;
+        default:
+            ret = lseek(fd, off, SEEK_SET) < 0 ? -1 : 0;
+            break;
+        }
+        record(&w->stats[op], now_ns() - t0, ret);
+    }
+
+    close(fd);
+    free(buf);
+    return NULL;
+}
+
+static void parse_mix(char *arg) {
+    memset(weights, 0, sizeof(weights));
+    weight_total = 0;
+    for (char *tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+        char *eq = strchr(tok, '=');
+        int op;
+
+        for (op = 0; op < OP_MAX; op++)
+            if (eq && !strncmp(tok, op_names[op], eq - tok) && strlen(op_names[op]) == (size_t)(eq - tok))
+                break;
+        if (op == OP_MAX) {
+            fprintf(stderr, "bad mix entry '%s'\n", tok);
+            exit(1);
+        }
+        weights[op] = atoi(eq + 1);
+        weight_total += weights[op];
+    }
+    if (!weight_total) {
+        fprintf(stderr, "mix has no weight\n");
+        exit(1);
+    }
+}
+
+static void parse_sizes(char *arg) {
+    nsizes = 0;
+    for (char *tok = strtok(arg, ","); tok; tok = strtok(NULL, ",")) {
+        sizes = realloc(sizes, (nsizes + 1) * sizeof(*sizes));
+        sizes[nsizes] = strtoull(tok, NULL, 0);
+        if (!sizes[nsizes]) {
+            fprintf(stderr, "bad size '%s'\n", tok);
+            exit(1);
+        }
+        if (sizes[nsizes] > max_size)
+            max_size = sizes[nsizes];
+        nsizes++;
+    }
+}
+
+static void print_row(const char *name, const struct op_stats *s, double secs, int first) {
+    double ops_s = s->ops / secs, gb_s = s->bytes / secs / 1e9;
+    uint64_t p50 = percentile(s, 0.50), p99 = percentile(s, 0.99), p999 = percentile(s, 0.999);
+
+    if (json)
+        printf("%s    {\"op\": \"%s\", \"ops\": %llu, \"errors\": %llu, \"ops_per_s\": %.1f, "
+               "\"gb_per_s\": %.4f, \"p50_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+               first ? "" : ",\n", name, (unsigned long long)s->ops, (unsigned long long)s->errors,
+               ops_s, gb_s, (unsigned long long)p50, (unsigned long long)p99,
+               (unsigned long long)p999, (unsigned long long)s->max_ns);
+    else
+        printf("%s,%d,%.2f,%s,%llu,%llu,%.1f,%.4f,%llu,%llu,%llu,%llu\n", device, nthreads, secs, name,
+               (unsigned long long)s->ops, (unsigned long long)s->errors, ops_s, gb_s,
+               (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999,
+               (unsigned long long)s->max_ns);
+}
+
+int main(int argc, char *argv[]) {
+    struct op_stats total[OP_MAX + 1];
+    struct worker *workers;
+    cpu_set_t allowed;
+    uint64_t t0, t1;
+    int opt, cpu;
+
+    while ((opt = getopt(argc, argv, "d:t:pm:s:r:I:a:D:o:H")) != -1) {
+        switch (opt) {
+        case 'd': device = optarg; break;
+        case 't': nthreads = atoi(optarg); break;
+        case 'p': pin = 1; break;
+        case 'm': parse_mix(optarg); break;
+        case 's': parse_sizes(optarg); break;
+        case 'r': span = strtoull(optarg, NULL, 0); break;
+        case 'I': ioctl_cmd = strtoul(optarg, NULL, 0); break;
+        case 'a': ioctl_arg = atoi(optarg); break;
+        case 'D': duration = atof(optarg); break;
+        case 'o': json = !strcmp(optarg, "json"); break;
+        case 'H': no_header = 1; break;
+        default:
+            fprintf(stderr, "see the comment at the top of %s for usage\n", __FILE__);
+            return 1;
+        }
+    }
+    if (!device || nthreads < 1) {
+        fprintf(stderr, "Usage: %s -d /dev/node [-t threads] [-p] [-m mix] [-s sizes] [-r span] "
+                "[-I ioctl] [-a arg] [-D secs] [-o csv|json] [-H]\n", argv[0]);
+        return 1;
+    }
+    if (!nsizes) {
+        char def[] = "4096";
+        parse_sizes(def);
+    }
+    if (weights[OP_IOCTL] && !ioctl_cmd) {
+        fprintf(stderr, "ioctl in the mix needs -I <request>\n");
+        return 1;
+    }
+
+    workers = aligned_alloc(64, nthreads * sizeof(*workers));
+    if (!workers)
+        return 1;
+    memset(workers, 0, nthreads * sizeof(*workers));
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    pthread_barrier_init(&start_barrier, NULL, nthreads + 1);
+
+    cpu = -1;
+    for (int i = 0; i < nthreads; i++) {
+        // Round-robin over the CPUs this process may run on
+        do {
+            cpu = (cpu + 1) % CPU_SETSIZE;
+        } while (!CPU_ISSET(cpu, &allowed));
+        workers[i].index = i;
+        workers[i].cpu = cpu;
+        workers[i].rng = 0x9e3779b97f4a7c15ull * (i + 1);
+        pthread_create(&workers[i].tid, NULL, worker_main, &workers[i]);
+    }
+
+    pthread_barrier_wait(&start_barrier);
+    t0 = now_ns();
+    usleep((useconds_t)(duration * 1e6));
+    stop = 1;
+    for (int i = 0; i < nthreads; i++)
+        pthread_join(workers[i].tid, NULL);
+    t1 = now_ns();
+
+    // Merge per-thread stats; slot OP_MAX accumulates every op type
+    memset(total, 0, sizeof(total));
+    for (int i = 0; i < nthreads; i++) {
+        for (int op = 0; op < OP_MAX; op++) {
+            merge(&total[op], &workers[i].stats[op]);
+            merge(&total[OP_MAX], &workers[i].stats[op]);
+        }
+    }
+
+    double secs = (t1 - t0) / 1e9;
+    int first = 1;
+
+    if (json)
+        printf("{\n  \"device\": \"%s\", \"threads\": %d, \"pinned\": %s, \"duration_s\": %.2f,\n  \"results\": [\n",
+               device, nthreads, pin ? "true" : "false", secs);
+    else if (!no_header)
+        printf("device,threads,duration_s,op,ops,errors,ops_per_s,gb_per_s,p50_ns,p99_ns,p999_ns,max_ns\n");
+
+    for (int op = 0; op <= OP_MAX; op++) {
+        if (op < OP_MAX && !weights[op])
+            continue;
+        print_row(op < OP_MAX ? op_names[op] : "all", &total[op], secs, first);
+        first = 0;
+    }
+    if (json)
+        printf("\n  ]\n}\n");
+
+    free(workers);
+    free(sizes);
+    return 0;
+}
@@ -0,0 +1,308 @@
+/* ioctl dispatch-latency microbenchmark for every char driver's command set
+
+Runs each command in a tight loop for a fixed time at 1, 2, 4 ... CPUs (one
+pinned thread and one file descriptor per CPU) and reports ns/op per thread
+and aggregate Mops/s as CSV. All command numbers come from the shared
+include/uapi/chardev_ioctl.h, the same header the drivers are built with.
+Devices that are not loaded are skipped.
+
+The privileged cap_char_dev commands (FILL_UP, SEND_TO_DEV, SET_MODE) check
+CAP_SYS_ADMIN with capable(), which also runs the LSM hooks and audit. To see
+what that costs, run them without root:
+
+    ./ioctl_latency -f cap_char_dev
+
+Each privileged command then returns EPERM straight after capable() (counted
+in the errors column), while NOOP is a command number the driver rejects
+without calling it. Both go through the same dispatch, stats and tracepoint,
+so the privileged commands' ns/op minus NOOP's is the cost of a denied
+capable(). The capable column shows whether the check was granted or denied
+(judged by the effective uid).
+
+A pair such as trylock+unlock issues both commands in turn and counts each
+as one op. Pairs whose second command undoes the first (mutex lock/unlock)
+only run single-threaded, since a mutex must be released by its owner.
+spinlock_dev is measured in whichever mode (global or sharded) it is in.
+Note that wait_demo logs every command with printk.
+
+Build: make            (or: gcc -O2 -pthread -o ioctl_latency ioctl_latency.c)
+
+Options:
+    -t list     thread counts, e.g. 1,4,16 (default 1, 2, 4 ... online CPUs)
+    -D ms       time per command and thread count (default 200)
+    -f text     only commands whose "device/command" contains text
+    -H          omit the CSV header line
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include "../include/uapi/chardev_ioctl.h"
+
+enum arg_kind {
+    ARG_NONE, ARG_INT, ARG_CHAR, ARG_SIZE, ARG_USAGE, ARG_MY_DATA, ARG_BATCH, ARG_U64, ARG_SPIN_TOTAL,
+};
+
+#define F_SINGLE    (1 << 0)    // run with one thread only
+#define F_CAP       (1 << 1)    // capable()-checked command
+
+struct bench_cmd {
+    const char *dev;
+    const char *name;
+    unsigned long cmd;
+    unsigned long cmd2;         // second command of a pair, 0 if none
+    enum arg_kind arg;
+    int flags;
+};
+
+static const struct bench_cmd cmds[] = {
+    { "dynamic_ioctl_dev", "GET_SIZE",   IOCTL_GET_SIZE,  0, ARG_INT },
+    { "dynamic_ioctl_dev", "MAX_CMDS",   IOCTL_MAX_CMDS,  0, ARG_INT },
+    { "dynamic_ioctl_dev", "GET_USAGE",  IOCTL_GET_USAGE, 0, ARG_USAGE },
+    { "dynamic_ioctl_dev", "FILL_ZERO",  IOCTL_FILL_ZERO, 0, ARG_NONE },
+    { "dynamic_ioctl_dev", "FILL_CHAR",  IOCTL_FILL_CHAR, 0, ARG_CHAR },
+    { "dynamic_ioctl_dev", "SET_SIZE",   IOCTL_SET_SIZE,  0, ARG_SIZE },
+    { "dynamic_ioctl_dev", "BATCH(GET_SIZE)", IOCTL_BATCH, 0, ARG_BATCH },
+
+    // Unused command number: dispatch only, the baseline for the capable() commands
+    { "cap_char_dev", "NOOP",        _IO(CAP_IOCTL_BASE, 0), 0, ARG_NONE },
+    { "cap_char_dev", "RETRIEVE",    IOCTL_RETRIEVE,    0, ARG_MY_DATA },
+    { "cap_char_dev", "REREAD_DEV",  IOCTL_REREAD_DEV,  0, ARG_MY_DATA },
+    { "cap_char_dev", "FILL_UP",     IOCTL_FILL_UP,     0, ARG_MY_DATA, F_CAP },
+    { "cap_char_dev", "SEND_TO_DEV", IOCTL_SEND_TO_DEV, 0, ARG_MY_DATA, F_CAP },
+    { "cap_char_dev", "SET_MODE",    IOCTL_SET_MODE,    0, ARG_INT, F_CAP },
+
+    { "mutex_demo", "IS_LOCKED",      IOCTL_IS_LOCKED, 0, ARG_INT },
+    { "mutex_demo", "TRYLOCK+UNLOCK", IOCTL_TRYLOCK, IOCTL_UNLOCK, ARG_NONE, F_SINGLE },
+    { "mutex_demo", "LOCK+UNLOCK",    IOCTL_LOCK,    IOCTL_UNLOCK, ARG_NONE, F_SINGLE },
+
+    { "spinlock_dev", "SPIN_LOCK",         SPIN_LOCK,         0, ARG_NONE },
+    { "spinlock_dev", "SPIN_LOCK_IRQSAVE", SPIN_LOCK_IRQSAVE, 0, ARG_NONE },
+    { "spinlock_dev", "SPIN_LOCK_IRQ",     SPIN_LOCK_IRQ,     0, ARG_NONE },
+    { "spinlock_dev", "SPIN_LOCK_BH",      SPIN_LOCK_BH,      0, ARG_NONE },
+    { "spinlock_dev", "SPIN_ADD",          SPIN_ADD,          0, ARG_U64 },
+    { "spinlock_dev", "SPIN_READ_TOTAL",   SPIN_READ_TOTAL,   0, ARG_SPIN_TOTAL },
+
+    // WAKE_EVENT sets the condition for good, so WAIT_EVENT after it never sleeps
+    { "wait_demo", "WAKE_EVENT",               IOCTL_WAKE_EVENT, 0, ARG_NONE },
+    { "wait_demo", "WAIT_EVENT",               IOCTL_WAIT_EVENT, 0, ARG_NONE },
+    { "wait_demo", "COMPLETE+WAIT_COMPLETION", IOCTL_COMPLETE, IOCTL_WAIT_COMPLETION, ARG_NONE },
+};
+
+#define NCMDS (sizeof(cmds) / sizeof(cmds[0]))
+
+struct worker {
+    pthread_t tid;
+    int cpu;
+    int fd;
+    const struct bench_cmd *bc;
+    uint64_t ops;
+    uint64_t errors;
+    // Per-thread argument storage: threads never share an argument buffer
+    int i;
+    char c;
+    struct my_data data;
+    struct dynamic_ioctl_usage usage;
+    struct dynamic_ioctl_batch_entry entry;
+    struct dynamic_ioctl_batch batch;
+    uint64_t u64;
+    struct spin_total total;
+} __attribute__((aligned(64)));
+
+static volatile int stop;
+static pthread_barrier_t start_barrier;
+static int cur_size;            // dynamic_ioctl_dev size, so SET_SIZE is a same-size resize
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void *prepare_arg(struct worker *w) {
+    switch (w->bc->arg) {
+    case ARG_INT:
+        w->i = 0;       // also CAP_MODE_TEXT for SET_MODE
+        return &w->i;
+    case ARG_CHAR:
+        w->c = 'x';
+        return &w->c;
+    case ARG_SIZE:
+        w->i = cur_size;
+        return &w->i;
+    case ARG_USAGE:
+        return &w->usage;
+    case ARG_MY_DATA:
+        w->data.i = 1;
+        w->data.x = 2;
+        strcpy(w->data.s, "ioctl_latency");
+        return &w->data;
+    case ARG_BATCH:
+        w->entry.cmd = IOCTL_GET_SIZE;
+        w->batch.entries = (uintptr_t)&w->entry;
+        w->batch.count = 1;
+        return &w->batch;
+    case ARG_U64:
+        w->u64 = 1;
+        return &w->u64;
+    case ARG_SPIN_TOTAL:
+        return &w->total;
+    default:
+        return NULL;
+    }
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    const struct bench_cmd *bc = w->bc;
+    void *p = prepare_arg(w);
+    uint64_t ops = 0, errors = 0;
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(w->cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+        fprintf(stderr, "cannot pin to CPU %d\n", w->cpu);
+
+    pthread_barrier_wait(&start_barrier);
+    while (!stop) {
+        errors += ioctl(w->fd, bc->cmd, p) < 0;
+        ops++;
+        if (bc->cmd2) {
+            errors += ioctl(w->fd, bc->cmd2, p) < 0;
+            ops++;
+        }
+    }
+    w->ops = ops;
+    w->errors = errors;
+    return NULL;
+}
+
+static const char *capable_state(const struct bench_cmd *bc) {
+    if (!(bc->flags & F_CAP))
+        return "-";
+    return geteuid() == 0 ? "granted" : "denied";
+}
+
+// One command at @nthreads threads; returns -1 if the device cannot be opened
+static int run(const struct bench_cmd *bc, int nthreads, const int *cpus, int ms) {
+    struct worker *w = aligned_alloc(64, nthreads * sizeof(*w));
+    char path[64];
+    uint64_t t0, t1, ops = 0, errors = 0;
+    double ns;
+
+    if (!w)
+        return -1;
+    memset(w, 0, nthreads * sizeof(*w));
+    snprintf(path, sizeof(path), "/dev/%s", bc->dev);
+    for (int i = 0; i < nthreads; i++) {
+        w[i].fd = open(path, O_RDWR);
+        if (w[i].fd < 0) {
+            while (i--)
+                close(w[i].fd);
+            free(w);
+            return -1;
+        }
+        w[i].cpu = cpus[i];
+        w[i].bc = bc;
+    }
+
+    stop = 0;
+    pthread_barrier_init(&start_barrier, NULL, nthreads + 1);
+    for (int i = 0; i < nthreads; i++)
+        pthread_create(&w[i].tid, NULL, worker_main, &w[i]);
+    pthread_barrier_wait(&start_barrier);
+    t0 = now_ns();
+    usleep(ms * 1000);
+    stop = 1;
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(w[i].tid, NULL);
+        ops += w[i].ops;
+        errors += w[i].errors;
+        close(w[i].fd);
+    }
+    t1 = now_ns();
+    pthread_barrier_destroy(&start_barrier);
+
+    // Per-thread latency: every thread was issuing commands the whole time
+    ns = ops ? (double)(t1 - t0) * nthreads / ops : 0;
+    printf("%s,%s,%s,%d,%llu,%llu,%.1f,%.3f\n", bc->dev, bc->name, capable_state(bc), nthreads,
+           (unsigned long long)ops, (unsigned long long)errors, ns, ops / ((t1 - t0) / 1e3));
+    fflush(stdout);
+    free(w);
+    return 0;
+}
+
+static int parse_threads(char *arg, int *list, int max) {
+    int n = 0;
+
+    for (char *tok = strtok(arg, ","); tok && n < max; tok = strtok(NULL, ","))
+        if ((list[n] = atoi(tok)) > 0)
+            n++;
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    int threads[64], nthreads_list = 0, ms = 200, no_header = 0;
+    int cpus[CPU_SETSIZE], ncpus = 0;
+    const char *filter = NULL;
+    cpu_set_t allowed;
+    char name[128];
+    int opt, fd;
+
+    while ((opt = getopt(argc, argv, "t:D:f:H")) != -1) {
+        switch (opt) {
+        case 't': nthreads_list = parse_threads(optarg, threads, 64); break;
+        case 'D': ms = atoi(optarg); break;
+        case 'f': filter = optarg; break;
+        case 'H': no_header = 1; break;
+        default:
+            fprintf(stderr, "Usage: %s [-t 1,2,4] [-D ms] [-f filter] [-H]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, &allowed))
+            cpus[ncpus++] = cpu;
+    if (!nthreads_list) {
+        for (int t = 1; t < ncpus && nthreads_list < 63; t *= 2)
+            threads[nthreads_list++] = t;
+        threads[nthreads_list++] = ncpus;
+    }
+
+    fd = open("/dev/dynamic_ioctl_dev", O_RDONLY);
+    if (fd >= 0) {
+        if (ioctl(fd, IOCTL_GET_SIZE, &cur_size) < 0)
+            cur_size = 1024;
+        close(fd);
+    }
+
+    if (!no_header)
+        printf("device,command,capable,threads,ops,errors,ns_per_op,mops_per_s\n");
+    for (size_t c = 0; c < NCMDS; c++) {
+        const struct bench_cmd *bc = &cmds[c];
+
+        snprintf(name, sizeof(name), "%s/%s", bc->dev, bc->name);
+        if (filter && !strstr(name, filter))
+            continue;
+        for (int t = 0; t < nthreads_list; t++) {
+            if (threads[t] > ncpus || (threads[t] > 1 && (bc->flags & F_SINGLE)))
+                continue;
+            if (run(bc, threads[t], cpus, ms) < 0) {
+                fprintf(stderr, "%s: /dev/%s: %s, skipped\n", bc->name, bc->dev, strerror(errno));
+                break;
+            }
+        }
+    }
+    return 0;
+}
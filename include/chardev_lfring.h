@@ -0,0 +1,298 @@
+/* Lockless rings for the ring mode of mutex_demo and sem_variants
+
+The drivers' shared buffer serialises every writer and reader on one lock.
+In ring mode (RING_MODE_* in uapi/chardev_ioctl.h) read() and write() go to
+one of these instead, and neither takes a lock on the fast path. (Unlike
+chardev_ring.h, the producer API of ring_char_dev, whose producers still
+take a spinlock to move head and commit.)
+
+RING_MODE_SPSC is a kfifo byte ring. kfifo needs no lock as long as only one
+task puts and one task gets at a time; instead of trusting callers with
+that, each side claims its end with one bit (a second writer or reader gets
+-EBUSY rather than corrupting the ring). The bit lives in the ring's control
+cache line, which the producer and consumer each touch once per call.
+
+RING_MODE_MPMC is a bounded array of fixed-size messages with a sequence
+number per slot (D. Vyukov's MPMC queue). A producer claims the slot at head
+with one cmpxchg when its sequence says it is free, fills it and publishes it
+by storing the next sequence with release semantics; consumers do the same at
+tail. Producers only contend with producers and consumers with consumers, on
+head and tail, which sit on separate cache lines. Data is staged on the stack:
+a user copy may fault and sleep, and a half-written slot stalls every
+consumer behind it.
+
+A full ring (write) or empty ring (read) is explicit backpressure: -EAGAIN on
+an O_NONBLOCK file, otherwise the caller sleeps until the other side makes
+progress. Wakeups are only issued when someone sleeps (wq_has_sleeper()), so
+a ring that keeps up never touches the wait queue locks.
+
+    /sys/kernel/debug/<driver>/ring    fill levels and backpressure counts
+
+Usage in a driver:
+
+    static struct chardev_lfring ring;                 // chardev_lfring_init()
+    ...
+    if (mode != RING_MODE_OFF)
+        return chardev_lfring_read(&ring, mode, buf, len, file->f_flags & O_NONBLOCK);
+*/
+
+#ifndef _CHARDEV_LFRING_H
+#define _CHARDEV_LFRING_H
+
+#include <linux/kfifo.h>
+#include <linux/wait.h>
+#include <linux/atomic.h>
+#include <linux/bitops.h>
+#include <linux/uaccess.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include "uapi/chardev_ioctl.h"
+
+#define CHARDEV_LFRING_BYTES  (64 * 1024)     // each ring; a power of two
+
+struct chardev_lfring_slot {
+    unsigned long seq;              // == position: free; == position + 1: full
+    unsigned int len;
+    char data[RING_MSG_MAX];
+};
+
+#define CHARDEV_LFRING_SLOTS  (CHARDEV_LFRING_BYTES / sizeof(struct chardev_lfring_slot))
+
+enum { CHARDEV_LFRING_WRITER, CHARDEV_LFRING_READER };     // bits of spsc_busy
+
+struct chardev_lfring {
+    struct kfifo fifo;
+    unsigned long spsc_busy;
+    struct chardev_lfring_slot *slots;
+    atomic_long_t head ____cacheline_aligned_in_smp;   // next MPMC slot to fill
+    atomic_long_t tail ____cacheline_aligned_in_smp;   // next MPMC slot to drain
+    wait_queue_head_t readers ____cacheline_aligned_in_smp;
+    wait_queue_head_t writers;
+    atomic_long_t full_waits;       // backpressure events, slow path only
+    atomic_long_t empty_waits;
+};
+
+static inline bool chardev_lfring_mpmc_full(struct chardev_lfring *r)
+{
+    unsigned long pos = atomic_long_read(&r->head);
+
+    return smp_load_acquire(&r->slots[pos % CHARDEV_LFRING_SLOTS].seq) != pos;
+}
+
+static inline bool chardev_lfring_mpmc_empty(struct chardev_lfring *r)
+{
+    unsigned long pos = atomic_long_read(&r->tail);
+
+    return smp_load_acquire(&r->slots[pos % CHARDEV_LFRING_SLOTS].seq) != pos + 1;
+}
+
+static inline bool chardev_lfring_full(struct chardev_lfring *r, int mode)
+{
+    return mode == RING_MODE_SPSC ? kfifo_is_full(&r->fifo) : chardev_lfring_mpmc_full(r);
+}
+
+static inline bool chardev_lfring_empty(struct chardev_lfring *r, int mode)
+{
+    return mode == RING_MODE_SPSC ? kfifo_is_empty(&r->fifo) : chardev_lfring_mpmc_empty(r);
+}
+
+// Queue one message; false if the ring is full
+static inline bool chardev_lfring_mpmc_put(struct chardev_lfring *r, const void *msg, unsigned int len)
+{
+    unsigned long pos = atomic_long_read(&r->head);
+    struct chardev_lfring_slot *slot;
+
+    for (;;) {
+        long diff;
+
+        slot = &r->slots[pos % CHARDEV_LFRING_SLOTS];
+        diff = (long)(smp_load_acquire(&slot->seq) - pos);
+        if (diff == 0) {
+            if (atomic_long_try_cmpxchg_relaxed(&r->head, (long *)&pos, pos + 1))
+                break;
+        } else if (diff < 0) {
+            return false;   // still holds the message from one lap ago
+        } else {
+            pos = atomic_long_read(&r->head);
+        }
+    }
+    memcpy(slot->data, msg, len);
+    slot->len = len;
+    smp_store_release(&slot->seq, pos + 1);
+    return true;
+}
+
+// Take one message into @msg (RING_MSG_MAX bytes); its length, or -1 if the ring is empty
+static inline int chardev_lfring_mpmc_get(struct chardev_lfring *r, void *msg)
+{
+    unsigned long pos = atomic_long_read(&r->tail);
+    struct chardev_lfring_slot *slot;
+    unsigned int len;
+
+    for (;;) {
+        long diff;
+
+        slot = &r->slots[pos % CHARDEV_LFRING_SLOTS];
+        diff = (long)(smp_load_acquire(&slot->seq) - (pos + 1));
+        if (diff == 0) {
+            if (atomic_long_try_cmpxchg_relaxed(&r->tail, (long *)&pos, pos + 1))
+                break;
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_long_read(&r->tail);
+        }
+    }
+    len = slot->len;
+    memcpy(msg, slot->data, len);
+    // Free for the producer that reaches this slot on the next lap
+    smp_store_release(&slot->seq, pos + CHARDEV_LFRING_SLOTS);
+    return len;
+}
+
+// One attempt at a write; 0 if the ring is full
+static inline ssize_t chardev_lfring_put_user(struct chardev_lfring *r, int mode,
+                                              const char __user *buf, size_t len)
+{
+    char msg[RING_MSG_MAX];
+    unsigned int copied;
+
+    if (mode == RING_MODE_SPSC) {
+        if (kfifo_from_user(&r->fifo, buf, len, &copied))
+            return -EFAULT;
+        return copied;
+    }
+    len = min_t(size_t, len, sizeof(msg));
+    if (copy_from_user(msg, buf, len))
+        return -EFAULT;
+    return chardev_lfring_mpmc_put(r, msg, len) ? len : 0;
+}
+
+// One attempt at a read; 0 if the ring is empty
+static inline ssize_t chardev_lfring_get_user(struct chardev_lfring *r, int mode,
+                                              char __user *buf, size_t len)
+{
+    char msg[RING_MSG_MAX];
+    unsigned int copied;
+    int n;
+
+    if (mode == RING_MODE_SPSC) {
+        if (kfifo_to_user(&r->fifo, buf, len, &copied))
+            return -EFAULT;
+        return copied;
+    }
+    n = chardev_lfring_mpmc_get(r, msg);
+    if (n < 0)
+        return 0;
+    n = min_t(size_t, n, len);
+    return copy_to_user(buf, msg, n) ? -EFAULT : n;
+}
+
+static inline ssize_t chardev_lfring_write(struct chardev_lfring *r, int mode, const char __user *buf,
+                                           size_t len, bool nonblock)
+{
+    ssize_t ret;
+
+    if (!len)
+        return 0;
+    if (mode == RING_MODE_SPSC && test_and_set_bit_lock(CHARDEV_LFRING_WRITER, &r->spsc_busy))
+        return -EBUSY;
+
+    while (!(ret = chardev_lfring_put_user(r, mode, buf, len))) {
+        atomic_long_inc(&r->full_waits);
+        if (nonblock) {
+            ret = -EAGAIN;
+            break;
+        }
+        if (wait_event_interruptible(r->writers, !chardev_lfring_full(r, mode))) {
+            ret = -ERESTARTSYS;
+            break;
+        }
+    }
+
+    if (mode == RING_MODE_SPSC)
+        clear_bit_unlock(CHARDEV_LFRING_WRITER, &r->spsc_busy);
+    // Pairs with the barrier in prepare_to_wait() of a reader that found the ring empty
+    if (ret > 0 && wq_has_sleeper(&r->readers))
+        wake_up_interruptible(&r->readers);
+    return ret;
+}
+
+static inline ssize_t chardev_lfring_read(struct chardev_lfring *r, int mode, char __user *buf,
+                                          size_t len, bool nonblock)
+{
+    ssize_t ret;
+
+    // Writes are never empty, so a 0 from chardev_lfring_get_user() means "no data yet"
+    if (!len)
+        return 0;
+    if (mode == RING_MODE_SPSC && test_and_set_bit_lock(CHARDEV_LFRING_READER, &r->spsc_busy))
+        return -EBUSY;
+
+    while (!(ret = chardev_lfring_get_user(r, mode, buf, len))) {
+        atomic_long_inc(&r->empty_waits);
+        if (nonblock) {
+            ret = -EAGAIN;
+            break;
+        }
+        if (wait_event_interruptible(r->readers, !chardev_lfring_empty(r, mode))) {
+            ret = -ERESTARTSYS;
+            break;
+        }
+    }
+
+    if (mode == RING_MODE_SPSC)
+        clear_bit_unlock(CHARDEV_LFRING_READER, &r->spsc_busy);
+    if (ret > 0 && wq_has_sleeper(&r->writers))
+        wake_up_interruptible(&r->writers);
+    return ret;
+}
+
+static int chardev_lfring_show(struct seq_file *m, void *v)
+{
+    struct chardev_lfring *r = m->private;
+
+    seq_printf(m, "spsc: %u of %u bytes used\n", kfifo_len(&r->fifo), kfifo_size(&r->fifo));
+    seq_printf(m, "mpmc: %ld of %zu messages queued\n",
+               atomic_long_read(&r->head) - atomic_long_read(&r->tail), CHARDEV_LFRING_SLOTS);
+    seq_printf(m, "full waits %ld, empty waits %ld\n",
+               atomic_long_read(&r->full_waits), atomic_long_read(&r->empty_waits));
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(chardev_lfring);
+
+// Allocate both rings and publish their state as @parent/ring (if @parent)
+static inline int chardev_lfring_init(struct chardev_lfring *r, struct dentry *parent)
+{
+    unsigned int i;
+
+    if (kfifo_alloc(&r->fifo, CHARDEV_LFRING_BYTES, GFP_KERNEL))
+        return -ENOMEM;
+    r->slots = kvcalloc(CHARDEV_LFRING_SLOTS, sizeof(*r->slots), GFP_KERNEL);
+    if (!r->slots) {
+        kfifo_free(&r->fifo);
+        return -ENOMEM;
+    }
+    for (i = 0; i < CHARDEV_LFRING_SLOTS; i++)
+        r->slots[i].seq = i;
+    r->spsc_busy = 0;
+    atomic_long_set(&r->head, 0);
+    atomic_long_set(&r->tail, 0);
+    atomic_long_set(&r->full_waits, 0);
+    atomic_long_set(&r->empty_waits, 0);
+    init_waitqueue_head(&r->readers);
+    init_waitqueue_head(&r->writers);
+
+    if (parent)
+        debugfs_create_file("ring", 0444, parent, r, &chardev_lfring_fops);
+    return 0;
+}
+
+static inline void chardev_lfring_exit(struct chardev_lfring *r)
+{
+    kvfree(r->slots);
+    kfifo_free(&r->fifo);
+}
+
+#endif /* _CHARDEV_LFRING_H */
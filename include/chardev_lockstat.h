@@ -0,0 +1,305 @@
+/* Always-on lock contention statistics for the synchronization drivers
+
+lockstat (CONFIG_LOCK_STAT) instruments every lock in the kernel and is too
+heavy to leave on. This wraps just the locks a driver names: each
+acquisition first tries the lock's trylock and only reads the clock to time
+the wait when that fails, so an uncontended acquisition costs one trylock,
+one clock read (for the hold time) and a few per-CPU increments. Everything
+is recorded in per-CPU counters; nothing is shared between CPUs on the hot
+path.
+
+Per lock it records acquisitions, contended acquisitions (the trylock
+failed), failed acquisitions (signal, timeout, trylock-only callers), log2
+histograms of wait time (contended acquisitions only) and hold time, and a
+small per-CPU table of contending call sites with the last task that
+contended there. The table is direct-mapped by call site: two sites that
+hash to the same entry evict each other, so it answers "who is contending
+right now", not an exact per-site history.
+
+    /sys/kernel/debug/<driver>/locks/<lock>    read: counters, histograms and
+                                               top contenders; write: reset
+
+Usage in a driver, for a lock held by one owner at a time:
+
+    static struct chardev_lockstat my_lock_stat;     // chardev_lockstat_init()
+    static u64 my_lock_since;                        // when the owner got it
+    ...
+    chardev_lockstat_lock(&my_lock_stat, my_lock_since,
+                          spin_trylock(&my_lock), spin_lock(&my_lock));
+    ...
+    chardev_lockstat_unlock(&my_lock_stat, my_lock_since, spin_unlock(&my_lock));
+
+    ret = chardev_lockstat_lock_err(&my_mutex_stat, my_mutex_since,
+                                    mutex_trylock(&my_mutex),
+                                    mutex_lock_interruptible(&my_mutex));
+
+A lock with several holders at once (a counting semaphore) keeps one "since"
+per holder instead of one per lock. Times come from local_clock(): cheap, but
+only roughly comparable between CPUs, so a hold that migrates may be off by
+a little (never negative: such holds count as 0 ns).
+*/
+
+#ifndef _CHARDEV_LOCKSTAT_H
+#define _CHARDEV_LOCKSTAT_H
+
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/sched.h>
+#include <linux/sched/clock.h>
+#include <linux/hash.h>
+#include <linux/math64.h>
+#include <linux/sort.h>
+#include <linux/slab.h>
+#include "chardev_stats.h"
+
+#define CHARDEV_LOCKSTAT_SITE_BITS  4
+#define CHARDEV_LOCKSTAT_SITES      (1 << CHARDEV_LOCKSTAT_SITE_BITS)
+#define CHARDEV_LOCKSTAT_TOP        10
+
+struct chardev_lockstat_site {
+    unsigned long ip;               // where the contended acquisition was made
+    u64 contended;
+    u64 wait_ns;
+    pid_t pid;                      // last task that contended here
+    char comm[TASK_COMM_LEN];
+};
+
+struct chardev_lockstat_cpu {
+    u64 acquires;
+    u64 contended;
+    u64 failed;
+    u64 wait_ns;
+    u64 hold_ns;
+    u64 wait_hist[CHARDEV_HIST_BUCKETS];
+    u64 hold_hist[CHARDEV_HIST_BUCKETS];
+    struct chardev_lockstat_site sites[CHARDEV_LOCKSTAT_SITES];
+};
+
+struct chardev_lockstat {
+    const char *name;
+    struct chardev_lockstat_cpu __percpu *pcpu;
+};
+
+static inline void chardev_lockstat_contended(struct chardev_lockstat *ls, u64 wait,
+                                              unsigned long ip)
+{
+    struct chardev_lockstat_cpu *c = get_cpu_ptr(ls->pcpu);
+    struct chardev_lockstat_site *s = &c->sites[hash_long(ip, CHARDEV_LOCKSTAT_SITE_BITS)];
+
+    c->contended++;
+    c->wait_ns += wait;
+    c->wait_hist[chardev_hist_bucket(wait)]++;
+    if (s->ip != ip) {
+        s->ip = ip;
+        s->contended = 0;
+        s->wait_ns = 0;
+    }
+    s->contended++;
+    s->wait_ns += wait;
+    s->pid = task_pid_nr(current);
+    get_task_comm(s->comm, current);
+    put_cpu_ptr(ls->pcpu);
+}
+
+/*
+ * Account an acquisition made at @ip. @wait_start is the local_clock() at
+ * which the caller started to wait, 0 if its trylock succeeded. Returns the
+ * acquisition time to hand to chardev_lockstat_release().
+ */
+static inline u64 chardev_lockstat_acquired(struct chardev_lockstat *ls, u64 wait_start,
+                                            unsigned long ip)
+{
+    u64 now = local_clock();
+
+    this_cpu_inc(ls->pcpu->acquires);
+    if (wait_start)
+        chardev_lockstat_contended(ls, now > wait_start ? now - wait_start : 0, ip);
+    return now;
+}
+
+// The caller gave up: it was contended and never got the lock
+static inline void chardev_lockstat_failed(struct chardev_lockstat *ls, u64 wait_start,
+                                           unsigned long ip)
+{
+    u64 now = local_clock();
+
+    this_cpu_inc(ls->pcpu->failed);
+    chardev_lockstat_contended(ls, now > wait_start ? now - wait_start : 0, ip);
+}
+
+static inline void chardev_lockstat_release(struct chardev_lockstat *ls, u64 since)
+{
+    u64 now = local_clock(), hold = now > since ? now - since : 0;
+
+    this_cpu_add(ls->pcpu->hold_ns, hold);
+    this_cpu_inc(ls->pcpu->hold_hist[chardev_hist_bucket(hold)]);
+}
+
+/*
+ * Acquire with @trylock (true on success) and only if that fails with
+ * @lock, which waits and evaluates to 0 or a negative errno. On success the
+ * acquisition time goes to @since (an lvalue). Evaluates to @lock's result.
+ */
+#define chardev_lockstat_lock_err(ls, since, trylock, lock) ({                  \
+    u64 __wait = 0;                                                             \
+    int __err = 0;                                                              \
+                                                                                \
+    if (!(trylock)) {                                                           \
+        __wait = local_clock() ?: 1;                                            \
+        __err = (lock);                                                         \
+    }                                                                           \
+    if (__err)                                                                  \
+        chardev_lockstat_failed(ls, __wait, _THIS_IP_);                         \
+    else                                                                        \
+        (since) = chardev_lockstat_acquired(ls, __wait, _THIS_IP_);             \
+    __err;                                                                      \
+})
+
+// As above for a @lock statement that cannot fail
+#define chardev_lockstat_lock(ls, since, trylock, lock)                         \
+    ((void)chardev_lockstat_lock_err(ls, since, trylock, ({ lock; 0; })))
+
+// Account the hold that began at @since, then run the @unlock statement
+#define chardev_lockstat_unlock(ls, since, unlock) do {                         \
+    chardev_lockstat_release(ls, since);                                        \
+    unlock;                                                                     \
+} while (0)
+
+static int chardev_lockstat_site_cmp(const void *a, const void *b)
+{
+    const struct chardev_lockstat_site *x = a, *y = b;
+
+    return x->wait_ns < y->wait_ns ? 1 : x->wait_ns > y->wait_ns ? -1 : 0;
+}
+
+static int chardev_lockstat_show(struct seq_file *m, void *v)
+{
+    struct chardev_lockstat *ls = m->private;
+    struct chardev_lockstat_site *sites;
+    struct chardev_lockstat_cpu *sum;
+    unsigned int nsites = 0, j;
+    int cpu, i;
+
+    sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+    sites = kcalloc(num_possible_cpus(), sizeof(sum->sites), GFP_KERNEL);
+    if (!sum || !sites) {
+        kfree(sum);
+        kfree(sites);
+        return -ENOMEM;
+    }
+
+    for_each_possible_cpu(cpu) {
+        struct chardev_lockstat_cpu *c = per_cpu_ptr(ls->pcpu, cpu);
+
+        sum->acquires += READ_ONCE(c->acquires);
+        sum->contended += READ_ONCE(c->contended);
+        sum->failed += READ_ONCE(c->failed);
+        sum->wait_ns += READ_ONCE(c->wait_ns);
+        sum->hold_ns += READ_ONCE(c->hold_ns);
+        for (i = 0; i < CHARDEV_HIST_BUCKETS; i++) {
+            sum->wait_hist[i] += READ_ONCE(c->wait_hist[i]);
+            sum->hold_hist[i] += READ_ONCE(c->hold_hist[i]);
+        }
+        // Merge the per-CPU entries of the same call site
+        for (i = 0; i < CHARDEV_LOCKSTAT_SITES; i++) {
+            struct chardev_lockstat_site s = c->sites[i];
+
+            if (!s.ip)
+                continue;
+            for (j = 0; j < nsites && sites[j].ip != s.ip; j++)
+                ;
+            if (j == nsites)
+                sites[nsites++] = s;
+            else {
+                sites[j].contended += s.contended;
+                sites[j].wait_ns += s.wait_ns;
+            }
+        }
+    }
+
+    seq_printf(m, "%s: %llu acquires, %llu contended, %llu failed\n", ls->name,
+               sum->acquires, sum->contended, sum->failed);
+    seq_printf(m, "mean wait %llu ns (contended), mean hold %llu ns\n",
+               sum->contended ? div64_u64(sum->wait_ns, sum->contended) : 0,
+               sum->acquires ? div64_u64(sum->hold_ns, sum->acquires) : 0);
+
+    seq_puts(m, "\nwait (ns):\n");
+    for (i = 0; i < CHARDEV_HIST_BUCKETS; i++)
+        if (sum->wait_hist[i])
+            seq_printf(m, "  %12llu .. %-12llu %12llu\n", 1ULL << i, (2ULL << i) - 1, sum->wait_hist[i]);
+    seq_puts(m, "\nhold (ns):\n");
+    for (i = 0; i < CHARDEV_HIST_BUCKETS; i++)
+        if (sum->hold_hist[i])
+            seq_printf(m, "  %12llu .. %-12llu %12llu\n", 1ULL << i, (2ULL << i) - 1, sum->hold_hist[i]);
+
+    sort(sites, nsites, sizeof(*sites), chardev_lockstat_site_cmp, NULL);
+    seq_printf(m, "\ntop contenders:\n  %12s %14s  %-24s %s\n", "contended", "wait_ns", "last task", "site");
+    for (j = 0; j < min_t(unsigned int, nsites, CHARDEV_LOCKSTAT_TOP); j++)
+        seq_printf(m, "  %12llu %14llu  %-16s %7d %pS\n", sites[j].contended, sites[j].wait_ns,
+                   sites[j].comm, sites[j].pid, (void *)sites[j].ip);
+
+    kfree(sites);
+    kfree(sum);
+    return 0;
+}
+
+static int chardev_lockstat_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, chardev_lockstat_show, inode->i_private);
+}
+
+// Any write clears the counters; like chardev_stats, not atomic against CPUs in flight
+static ssize_t chardev_lockstat_write(struct file *file, const char __user *buf,
+                                      size_t len, loff_t *ppos)
+{
+    struct chardev_lockstat *ls = ((struct seq_file *)file->private_data)->private;
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(ls->pcpu, cpu), 0, sizeof(struct chardev_lockstat_cpu));
+    return len;
+}
+
+static const struct file_operations chardev_lockstat_fops = {
+    .owner = THIS_MODULE,
+    .open = chardev_lockstat_open,
+    .read = seq_read,
+    .write = chardev_lockstat_write,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
+
+/*
+ * Allocate the per-CPU counters of lock @name and publish them as
+ * @parent/locks/@name (@parent may be NULL: then only the counters exist).
+ */
+static inline int chardev_lockstat_init(struct chardev_lockstat *ls, const char *name,
+                                        struct dentry *parent)
+{
+    struct dentry *dir;
+
+    ls->name = name;
+    ls->pcpu = alloc_percpu(struct chardev_lockstat_cpu);
+    if (!ls->pcpu)
+        return -ENOMEM;
+
+    // debugfs failures are not fatal, and the dir may already exist for another lock
+    if (parent) {
+        dir = debugfs_lookup("locks", parent);
+        if (!dir)
+            dir = debugfs_create_dir("locks", parent);
+        else
+            dput(dir);
+        debugfs_create_file(name, 0644, dir, ls, &chardev_lockstat_fops);
+    }
+    return 0;
+}
+
+// The debugfs files go away with the driver's directory
+static inline void chardev_lockstat_exit(struct chardev_lockstat *ls)
+{
+    free_percpu(ls->pcpu);
+}
+
+#endif /* _CHARDEV_LOCKSTAT_H */
@@ -0,0 +1,162 @@
+/* Byte-range reader/writer locks for the char drivers' buffers
+
+A single lock around a device buffer serialises every pread()/pwrite(),
+even ones that touch disjoint bytes. A range lock only serialises accesses
+whose ranges overlap and at least one of which writes: writers to disjoint
+regions, and any number of readers, run in parallel.
+
+Held ranges live in an interval tree (<linux/interval_tree.h>) under a
+spinlock that is held only to insert or remove a range, never while the
+caller copies data. A new range counts the conflicting ranges already in the
+tree and sleeps until that count drops to zero; releasing a range decrements
+the count of every conflicting range inserted after it. Ranges are granted
+in arrival order among overlapping requests, so writers are not starved.
+
+Usage in a driver:
+
+    static struct chardev_range_tree ranges;     // chardev_range_tree_init()
+    ...
+    struct chardev_range r;
+
+    ret = chardev_range_lock(&ranges, &r, pos, pos + len - 1, true);
+    if (ret)
+        return ret;                              // fatal signal while waiting
+    ...copy...
+    chardev_range_unlock(&ranges, &r);
+
+The struct chardev_range usually lives on the caller's stack. It may be
+released by another task than the one that locked it, e.g. a work item.
+*/
+
+#ifndef _CHARDEV_RANGE_LOCK_H
+#define _CHARDEV_RANGE_LOCK_H
+
+#include <linux/interval_tree.h>
+#include <linux/spinlock.h>
+#include <linux/sched.h>
+#include <linux/sched/signal.h>
+#include <linux/sched/wake_q.h>
+
+struct chardev_range_tree {
+    spinlock_t lock;
+    struct rb_root_cached root;
+    u64 seq;                        // arrival order of ranges
+};
+
+struct chardev_range {
+    struct interval_tree_node node; // [start, last], inclusive
+    struct task_struct *task;       // waiter to wake
+    u64 seq;
+    unsigned int blocked_by;        // earlier conflicting ranges still held
+    bool write;
+};
+
+static inline void chardev_range_tree_init(struct chardev_range_tree *tree)
+{
+    spin_lock_init(&tree->lock);
+    tree->root = RB_ROOT_CACHED;
+    tree->seq = 0;
+}
+
+static inline bool chardev_range_conflict(const struct chardev_range *a,
+                                          const struct chardev_range *b)
+{
+    return a->write || b->write;
+}
+
+// Take @r out of the tree and wake the later ranges it was the last blocker of
+static inline void chardev_range_remove(struct chardev_range_tree *tree, struct chardev_range *r)
+{
+    struct interval_tree_node *n;
+    DEFINE_WAKE_Q(wake_q);
+
+    spin_lock(&tree->lock);
+    interval_tree_remove(&r->node, &tree->root);
+    for (n = interval_tree_iter_first(&tree->root, r->node.start, r->node.last); n;
+         n = interval_tree_iter_next(n, r->node.start, r->node.last)) {
+        struct chardev_range *o = container_of(n, struct chardev_range, node);
+
+        if (o->seq < r->seq || !chardev_range_conflict(o, r))
+            continue;
+        // Pin the waiter before it can see zero and return
+        if (o->blocked_by == 1)
+            wake_q_add(&wake_q, o->task);
+        smp_store_release(&o->blocked_by, o->blocked_by - 1);
+    }
+    spin_unlock(&tree->lock);
+    wake_up_q(&wake_q);
+}
+
+/*
+ * Lock bytes [@start, @last] for reading or, if @write, writing. Sleeps until
+ * every earlier overlapping conflicting range is released. Returns 0, or
+ * -EINTR if a fatal signal arrived first (the range is then not held).
+ */
+static inline int chardev_range_lock(struct chardev_range_tree *tree, struct chardev_range *r,
+                                     unsigned long start, unsigned long last, bool write)
+{
+    struct interval_tree_node *n;
+
+    r->node.start = start;
+    r->node.last = last;
+    r->task = current;
+    r->blocked_by = 0;
+    r->write = write;
+
+    spin_lock(&tree->lock);
+    r->seq = tree->seq++;
+    for (n = interval_tree_iter_first(&tree->root, start, last); n;
+         n = interval_tree_iter_next(n, start, last))
+        if (chardev_range_conflict(container_of(n, struct chardev_range, node), r))
+            r->blocked_by++;
+    interval_tree_insert(&r->node, &tree->root);
+    spin_unlock(&tree->lock);
+
+    for (;;) {
+        set_current_state(TASK_KILLABLE);
+        // Pairs with the release in chardev_range_remove(): see the holder's writes
+        if (!smp_load_acquire(&r->blocked_by))
+            break;
+        if (fatal_signal_pending(current)) {
+            __set_current_state(TASK_RUNNING);
+            chardev_range_remove(tree, r);
+            return -EINTR;
+        }
+        schedule();
+    }
+    __set_current_state(TASK_RUNNING);
+    return 0;
+}
+
+// Lock without sleeping: 0 if granted at once, -EAGAIN otherwise (nothing held)
+static inline int chardev_range_trylock(struct chardev_range_tree *tree, struct chardev_range *r,
+                                        unsigned long start, unsigned long last, bool write)
+{
+    struct interval_tree_node *n;
+
+    r->node.start = start;
+    r->node.last = last;
+    r->task = current;
+    r->blocked_by = 0;
+    r->write = write;
+
+    spin_lock(&tree->lock);
+    for (n = interval_tree_iter_first(&tree->root, start, last); n;
+         n = interval_tree_iter_next(n, start, last)) {
+        if (chardev_range_conflict(container_of(n, struct chardev_range, node), r)) {
+            spin_unlock(&tree->lock);
+            return -EAGAIN;
+        }
+    }
+    r->seq = tree->seq++;
+    interval_tree_insert(&r->node, &tree->root);
+    spin_unlock(&tree->lock);
+    return 0;
+}
+
+static inline void chardev_range_unlock(struct chardev_range_tree *tree, struct chardev_range *r)
+{
+    chardev_range_remove(tree, r);
+}
+
+#endif /* _CHARDEV_RANGE_LOCK_H */
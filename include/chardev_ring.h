@@ -0,0 +1,47 @@
+/* In-kernel producer API of ring_char_dev (module/ring_char_dev.c)
+
+Other modules enqueue records straight into the device's ring, with no
+user-space round trip; readers of /dev/ring_char_dev receive them as a byte
+stream and are woken as records are published.
+
+Reserve/commit lets a producer build its record in place, in the ring slot
+itself, instead of in a staging buffer that is then copied:
+
+    struct chardev_ring_resv resv;
+
+    if (chardev_ring_reserve(&resv, len) == 0) {
+        fill_record(resv.data, len);        // write at most resv.size bytes
+        chardev_ring_commit(&resv, len);    // 0 discards the slot
+    }
+
+Neither call sleeps, so producers may run in any context, including hard
+IRQ. Reservations from several CPUs may be committed in any order; a record
+becomes readable once it and every record reserved before it are committed.
+A producer must commit every successful reservation, or the ring stalls.
+*/
+
+#ifndef _CHARDEV_RING_H
+#define _CHARDEV_RING_H
+
+#include <linux/types.h>
+
+struct chardev_ring_resv {
+    void *data;     // slot memory to fill
+    size_t size;    // usable bytes at @data (the slot size)
+    u32 seq;        // ring position, used by chardev_ring_commit()
+};
+
+/*
+ * Reserve one slot for a record of @len bytes. Returns 0, -EMSGSIZE if @len
+ * is 0 or larger than chardev_ring_max_record(), or -ENOSPC if the ring is
+ * full (readers are behind: drop or retry later).
+ */
+int chardev_ring_reserve(struct chardev_ring_resv *resv, size_t len);
+
+// Publish the first @used bytes of a reserved slot and wake readers
+void chardev_ring_commit(struct chardev_ring_resv *resv, size_t used);
+
+// Largest record a single reservation can hold
+size_t chardev_ring_max_record(void);
+
+#endif /* _CHARDEV_RING_H */
@@ -0,0 +1,190 @@
+/* Per-CPU operation counters and log2 latency histograms for the char drivers
+
+Every driver keeps one struct chardev_stats. The hot path only touches the
+current CPU's copy with this_cpu_*() operations: no lock, no shared cache line,
+no atomic read-modify-write across CPUs. Reading the stats walks the per-CPU
+copies and sums them, so collecting them never stalls the data path.
+
+    /sys/kernel/debug/<driver>/stats   per-op ops, bytes, errors, EFAULTs and
+                                       latency histograms (read, write, ioctl)
+    /sys/kernel/debug/<driver>/reset   write anything to zero the counters
+
+Usage in a driver:
+
+    static struct chardev_stats stats;
+    ...
+    u64 start = ktime_get_ns();
+    ret = ...;
+    ns = chardev_stats_record(&stats, CHARDEV_OP_READ, ret, start);
+
+Histogram bucket i counts operations that took [2^i, 2^(i+1)) ns; the last
+bucket also holds everything slower. Reset is not atomic against operations
+in flight on other CPUs, which may land just before or after it.
+*/
+
+#ifndef _CHARDEV_STATS_H
+#define _CHARDEV_STATS_H
+
+#include <linux/module.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/slab.h>
+#include <linux/fs.h>
+
+#define CHARDEV_HIST_BUCKETS 32   // 1 ns .. ~4.3 s
+
+enum chardev_stat_op {
+    CHARDEV_OP_READ,
+    CHARDEV_OP_WRITE,
+    CHARDEV_OP_IOCTL,
+    CHARDEV_OP_MAX,
+};
+
+static const char * const chardev_stat_op_names[CHARDEV_OP_MAX] = {
+    [CHARDEV_OP_READ]  = "read",
+    [CHARDEV_OP_WRITE] = "write",
+    [CHARDEV_OP_IOCTL] = "ioctl",
+};
+
+struct chardev_op_stats {
+    u64 ops;
+    u64 bytes;
+    u64 errors;
+    u64 efaults;
+    u64 hist[CHARDEV_HIST_BUCKETS];
+};
+
+struct chardev_cpu_stats {
+    struct chardev_op_stats op[CHARDEV_OP_MAX];
+};
+
+struct chardev_stats {
+    struct chardev_cpu_stats __percpu *pcpu;
+    struct dentry *dir;
+};
+
+// Histogram bucket of a @ns latency; also for drivers keeping histograms of their own
+static inline unsigned int chardev_hist_bucket(u64 ns)
+{
+    return ns ? min_t(unsigned int, ilog2(ns), CHARDEV_HIST_BUCKETS - 1) : 0;
+}
+
+/*
+ * Account one operation that started at @start_ns (ktime_get_ns()) and
+ * returned @ret: a byte count for read/write, 0 for ioctl, or a negative
+ * errno. Returns the measured latency so callers can reuse it for tracing.
+ */
+static inline u64 chardev_stats_record(struct chardev_stats *st, enum chardev_stat_op op,
+                                       long ret, u64 start_ns)
+{
+    u64 ns = ktime_get_ns() - start_ns;
+    unsigned int bucket = chardev_hist_bucket(ns);
+
+    this_cpu_inc(st->pcpu->op[op].ops);
+    if (ret >= 0) {
+        this_cpu_add(st->pcpu->op[op].bytes, ret);
+    } else {
+        this_cpu_inc(st->pcpu->op[op].errors);
+        if (ret == -EFAULT)
+            this_cpu_inc(st->pcpu->op[op].efaults);
+    }
+    this_cpu_inc(st->pcpu->op[op].hist[bucket]);
+    return ns;
+}
+
+static inline void chardev_stats_sum(struct chardev_stats *st, struct chardev_cpu_stats *sum)
+{
+    int cpu, op, i;
+
+    memset(sum, 0, sizeof(*sum));
+    for_each_possible_cpu(cpu) {
+        struct chardev_cpu_stats *c = per_cpu_ptr(st->pcpu, cpu);
+
+        for (op = 0; op < CHARDEV_OP_MAX; op++) {
+            sum->op[op].ops += READ_ONCE(c->op[op].ops);
+            sum->op[op].bytes += READ_ONCE(c->op[op].bytes);
+            sum->op[op].errors += READ_ONCE(c->op[op].errors);
+            sum->op[op].efaults += READ_ONCE(c->op[op].efaults);
+            for (i = 0; i < CHARDEV_HIST_BUCKETS; i++)
+                sum->op[op].hist[i] += READ_ONCE(c->op[op].hist[i]);
+        }
+    }
+}
+
+static inline void chardev_stats_reset(struct chardev_stats *st)
+{
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(st->pcpu, cpu), 0, sizeof(struct chardev_cpu_stats));
+}
+
+static int chardev_stats_show(struct seq_file *m, void *v)
+{
+    struct chardev_stats *st = m->private;
+    struct chardev_cpu_stats *sum;
+    int op, i;
+
+    sum = kmalloc(sizeof(*sum), GFP_KERNEL);
+    if (!sum)
+        return -ENOMEM;
+    chardev_stats_sum(st, sum);
+
+    seq_printf(m, "%-6s %14s %16s %10s %10s\n", "op", "ops", "bytes", "errors", "efaults");
+    for (op = 0; op < CHARDEV_OP_MAX; op++)
+        seq_printf(m, "%-6s %14llu %16llu %10llu %10llu\n", chardev_stat_op_names[op],
+                   sum->op[op].ops, sum->op[op].bytes, sum->op[op].errors, sum->op[op].efaults);
+
+    for (op = 0; op < CHARDEV_OP_MAX; op++) {
+        if (!sum->op[op].ops)
+            continue;
+        seq_printf(m, "\n%s latency (ns):\n", chardev_stat_op_names[op]);
+        for (i = 0; i < CHARDEV_HIST_BUCKETS; i++)
+            if (sum->op[op].hist[i])
+                seq_printf(m, "  %12llu .. %-12llu %12llu\n", 1ULL << i,
+                           (2ULL << i) - 1, sum->op[op].hist[i]);
+    }
+
+    kfree(sum);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(chardev_stats);
+
+static ssize_t chardev_stats_reset_write(struct file *file, const char __user *buf,
+                                         size_t len, loff_t *ppos)
+{
+    chardev_stats_reset(file->private_data);
+    return len;
+}
+
+static const struct file_operations chardev_stats_reset_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .write = chardev_stats_reset_write,
+    .llseek = noop_llseek,
+};
+
+// Allocate the per-CPU counters and publish them under /sys/kernel/debug/@name
+static inline int chardev_stats_init(struct chardev_stats *st, const char *name)
+{
+    st->pcpu = alloc_percpu(struct chardev_cpu_stats);
+    if (!st->pcpu)
+        return -ENOMEM;
+
+    // debugfs failures are not fatal: the driver works without its stats files
+    st->dir = debugfs_create_dir(name, NULL);
+    debugfs_create_file("stats", 0444, st->dir, st, &chardev_stats_fops);
+    debugfs_create_file("reset", 0200, st->dir, st, &chardev_stats_reset_fops);
+    return 0;
+}
+
+static inline void chardev_stats_exit(struct chardev_stats *st)
+{
+    debugfs_remove_recursive(st->dir);
+    free_percpu(st->pcpu);
+}
+
+#endif /* _CHARDEV_STATS_H */
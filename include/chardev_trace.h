@@ -0,0 +1,137 @@
+/* Tracepoints shared by the char drivers (open, read, write, ioctl, lock acquire)
+
+Each driver names its own trace system before including this header, so several
+drivers can be loaded at once without their events colliding:
+
+    #define CREATE_TRACE_POINTS
+    #define CHARDEV_TRACE_SYSTEM dynamic_char_dev
+    #include "chardev_trace.h"
+
+Tracepoints sit behind static keys: while disabled every trace_*() call is a
+patched-out jump, and its arguments (including the latency clock reads) are
+never evaluated. Consume them with ftrace, perf or trace-cmd:
+
+    echo 1 > /sys/kernel/tracing/events/dynamic_char_dev/enable
+    perf record -e 'dynamic_char_dev:*' -a
+    trace-cmd record -e dynamic_char_dev
+
+The per-directory Makefiles add include/ to the include path.
+*/
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM CHARDEV_TRACE_SYSTEM
+
+#if !defined(_CHARDEV_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _CHARDEV_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/string.h>
+
+TRACE_EVENT(chardev_open,
+    TP_PROTO(unsigned int minor),
+    TP_ARGS(minor),
+    TP_STRUCT__entry(
+        __field(unsigned int, minor)
+    ),
+    TP_fast_assign(
+        __entry->minor = minor;
+    ),
+    TP_printk("minor=%u", __entry->minor)
+);
+
+DECLARE_EVENT_CLASS(chardev_rw,
+    TP_PROTO(loff_t offset, ssize_t bytes, u64 latency_ns),
+    TP_ARGS(offset, bytes, latency_ns),
+    TP_STRUCT__entry(
+        __field(loff_t, offset)
+        __field(ssize_t, bytes)
+        __field(u64, latency_ns)
+    ),
+    TP_fast_assign(
+        __entry->offset = offset;
+        __entry->bytes = bytes;
+        __entry->latency_ns = latency_ns;
+    ),
+    TP_printk("offset=%lld bytes=%zd latency_ns=%llu",
+              __entry->offset, __entry->bytes, __entry->latency_ns)
+);
+
+// bytes is the return value: a negative errno on failure
+DEFINE_EVENT(chardev_rw, chardev_read,
+    TP_PROTO(loff_t offset, ssize_t bytes, u64 latency_ns),
+    TP_ARGS(offset, bytes, latency_ns)
+);
+
+DEFINE_EVENT(chardev_rw, chardev_write,
+    TP_PROTO(loff_t offset, ssize_t bytes, u64 latency_ns),
+    TP_ARGS(offset, bytes, latency_ns)
+);
+
+TRACE_EVENT(chardev_ioctl,
+    TP_PROTO(unsigned int cmd, long ret, u64 latency_ns),
+    TP_ARGS(cmd, ret, latency_ns),
+    TP_STRUCT__entry(
+        __field(unsigned int, cmd)
+        __field(long, ret)
+        __field(u64, latency_ns)
+    ),
+    TP_fast_assign(
+        __entry->cmd = cmd;
+        __entry->ret = ret;
+        __entry->latency_ns = latency_ns;
+    ),
+    TP_printk("cmd=0x%x ret=%ld latency_ns=%llu",
+              __entry->cmd, __entry->ret, __entry->latency_ns)
+);
+
+// lock/variant are short names ("my_mutex", "trylock"), copied so perf can read them
+TRACE_EVENT(chardev_lock,
+    TP_PROTO(const char *lock, const char *variant, int ret, u64 wait_ns),
+    TP_ARGS(lock, variant, ret, wait_ns),
+    TP_STRUCT__entry(
+        __array(char, lock, 16)
+        __array(char, variant, 16)
+        __field(int, ret)
+        __field(u64, wait_ns)
+    ),
+    TP_fast_assign(
+        strscpy(__entry->lock, lock, sizeof(__entry->lock));
+        strscpy(__entry->variant, variant, sizeof(__entry->variant));
+        __entry->ret = ret;
+        __entry->wait_ns = wait_ns;
+    ),
+    TP_printk("lock=%s variant=%s ret=%d wait_ns=%llu",
+              __entry->lock, __entry->variant, __entry->ret, __entry->wait_ns)
+);
+
+#endif /* _CHARDEV_TRACE_H */
+
+#ifndef _CHARDEV_TRACE_CLOCK_H
+#define _CHARDEV_TRACE_CLOCK_H
+
+#include <linux/ktime.h>
+
+/*
+ * Latency helpers: only read the clock when the event is enabled, e.g.
+ *     u64 start = chardev_trace_clock(trace_chardev_read_enabled());
+ *     ...
+ *     trace_chardev_read(pos, ret, chardev_trace_since(start));
+ * An event enabled mid-operation reports 0 rather than a bogus latency.
+ */
+static inline u64 chardev_trace_clock(bool enabled)
+{
+    return enabled ? ktime_get_ns() : 0;
+}
+
+static inline u64 chardev_trace_since(u64 start)
+{
+    return start ? ktime_get_ns() - start : 0;
+}
+
+#endif /* _CHARDEV_TRACE_CLOCK_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE chardev_trace
+#include <trace/define_trace.h>
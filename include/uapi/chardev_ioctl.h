@@ -0,0 +1,352 @@
+/* ioctl command sets of the char drivers, shared by the drivers and user space
+
+Every driver and every user application includes this one file instead of
+keeping its own copy of the numbers, so the two sides cannot drift apart
+(test_ioctl.c used to send 0xF0 commands to the 'D' driver).
+
+    Drivers (ccflags-y has ../include):  #include "uapi/chardev_ioctl.h"
+    Applications:                        #include "../../include/uapi/chardev_ioctl.h"
+
+Only <linux/ioctl.h> and <linux/types.h> are used, which both the kernel
+and user space provide. Each device has its own ioctl type byte:
+
+    'D'   /dev/dynamic_ioctl_dev   ioctl/dynamic_ioctl_char_dev.c
+    'W'   /dev/cap_char_dev        ioctl/dynamic_ioctl_cap_char_dev.c
+    'M'   /dev/mutex_demo          synchronization/dynamic_char_dev_ioctl_mutex.c
+    0xF0  /dev/spinlock_dev        synchronization/dynamic_char_dev_ioctl_spinlock.c
+    'x'   /dev/wait_demo           Block_IO/blocking_io.c
+    'L'   /dev/lock_bench          synchronization/lock_bench.c
+    'S'   /dev/sem_variants        synchronization/dynamic_char_dev_semaphore.c
+*/
+
+#ifndef _UAPI_CHARDEV_IOCTL_H
+#define _UAPI_CHARDEV_IOCTL_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/* ---- /dev/dynamic_ioctl_dev ---------------------------------------------- */
+
+#define DYNAMIC_IOCTL_BASE 'D'
+
+#define IOCTL_FILL_ZERO     _IO(DYNAMIC_IOCTL_BASE, 1)
+#define IOCTL_FILL_CHAR     _IOW(DYNAMIC_IOCTL_BASE, 2, char)
+#define IOCTL_SET_SIZE      _IOW(DYNAMIC_IOCTL_BASE, 3, int)
+#define IOCTL_GET_SIZE      _IOR(DYNAMIC_IOCTL_BASE, 4, int)
+#define IOCTL_MAX_CMDS      _IOR(DYNAMIC_IOCTL_BASE, 5, int)
+#define IOCTL_BATCH         _IOWR(DYNAMIC_IOCTL_BASE, 6, struct dynamic_ioctl_batch)
+#define IOCTL_FILL_ASYNC    _IOW(DYNAMIC_IOCTL_BASE, 7, char)
+#define IOCTL_GET_USAGE     _IOR(DYNAMIC_IOCTL_BASE, 8, struct dynamic_ioctl_usage)
+
+// IOCTL_GET_SIZE's int cannot describe a multi-GB buffer: GET_USAGE reports both in 64 bits
+struct dynamic_ioctl_usage {
+    __u64 size;       // logical buffer size
+    __u64 resident;   // memory actually allocated for it (populated chunks)
+};
+
+/*
+ * io_uring passthrough (IORING_OP_URING_CMD): sqe->cmd_op carries one of the
+ * IOCTL_* numbers above and the argument travels inline in sqe->cmd (16 bytes
+ * in a regular 64-byte SQE) instead of behind a user pointer. The command's
+ * result, e.g. the IOCTL_GET_SIZE value, comes back in cqe->res.
+ */
+struct dynamic_ioctl_uring_pdu {
+    __u64 arg;        // fill char for FILL_CHAR, new size for SET_SIZE
+    __u64 reserved;
+};
+
+/*
+ * IOCTL_BATCH runs an array of entries in one syscall: the array is copied in
+ * once, the entries run in order under a single acquisition of resize_sem,
+ * and all results are copied back once. An entry is either one of the
+ * commands above (argument inline in @arg, as for io_uring) or a data segment
+ * (BATCH_OP_READ/BATCH_OP_WRITE of @len bytes at @offset, from/to @addr).
+ * The ioctl returns the number of entries executed; each entry's @result is
+ * its own status: the GET_SIZE/MAX_CMDS value, bytes moved, 0 or -errno.
+ */
+#define BATCH_OP_READ       1
+#define BATCH_OP_WRITE      2
+#define BATCH_MAX_ENTRIES   1024
+#define BATCH_STOP_ON_ERROR (1U << 0)    // skip the rest (-ECANCELED) after a failure
+
+struct dynamic_ioctl_batch_entry {
+    __u32 cmd;        // IOCTL_* command or BATCH_OP_*
+    __s32 result;     // out
+    __u64 arg;        // fill char for FILL_CHAR, new size for SET_SIZE
+    __u64 offset;     // segment start in the device buffer
+    __u64 len;        // segment length
+    __u64 addr;       // segment user buffer
+};
+
+struct dynamic_ioctl_batch {
+    __u64 entries;    // user pointer to count entries
+    __u32 count;
+    __u32 flags;      // BATCH_*
+};
+
+/* ---- /dev/cap_char_dev ---------------------------------------------------- */
+
+#define CAP_IOCTL_BASE 'W'
+
+#define IOCTL_RETRIEVE      _IOR(CAP_IOCTL_BASE, 1, struct my_data *)
+#define IOCTL_FILL_UP       _IOW(CAP_IOCTL_BASE, 2, struct my_data *)
+#define IOCTL_SEND_TO_DEV   _IOW(CAP_IOCTL_BASE, 3, struct my_data *)
+#define IOCTL_REREAD_DEV    _IOR(CAP_IOCTL_BASE, 4, struct my_data *)
+#define IOCTL_SET_MODE      _IOW(CAP_IOCTL_BASE, 5, int)
+#define IOCTL_REC_APPEND    _IOW(CAP_IOCTL_BASE, 6, struct cap_record)
+#define IOCTL_REC_GET       _IOWR(CAP_IOCTL_BASE, 7, struct cap_rec_get)
+#define IOCTL_REC_GET_RANGE _IOWR(CAP_IOCTL_BASE, 8, struct cap_rec_range)
+
+struct my_data {
+    int i;
+    long x;
+    char s[100];
+};
+
+/*
+ * Buffer modes (IOCTL_SET_MODE, which also empties the buffer):
+ *
+ * CAP_MODE_TEXT   - SEND_TO_DEV formats one my_data as "i=.., x=.., s=.." and
+ *                   REREAD_DEV parses it back; s is cut at the first space.
+ * CAP_MODE_BINARY - the buffer is a cap_rec_header followed by an
+ *                   append-only array of packed cap_records, exactly what
+ *                   read() returns. SEND_TO_DEV appends a record and
+ *                   REREAD_DEV returns the newest one, both without any
+ *                   formatting. Records are fixed-width so the layout is the
+ *                   same for 32- and 64-bit user space.
+ */
+#define CAP_MODE_TEXT       0
+#define CAP_MODE_BINARY     1
+
+#define CAP_REC_MAGIC       0x43524543  // "CREC"
+#define CAP_REC_VERSION     1
+
+struct cap_rec_header {
+    __u32 magic;
+    __u16 version;
+    __u16 rec_size;     // sizeof(struct cap_record), for forward compatibility
+    __u32 count;        // records that follow the header
+    __u32 capacity;     // records the buffer can hold
+};
+
+struct cap_record {
+    __s32 i;
+    __s64 x;
+    char s[100];
+} __attribute__((packed));
+
+struct cap_rec_get {
+    __u32 index;        // in
+    __u32 reserved;
+    struct cap_record rec;  // out
+};
+
+struct cap_rec_range {
+    __u32 first;        // in: first index
+    __u32 count;        // in: records wanted, out: records copied
+    __u64 addr;         // user array of @count cap_records
+};
+
+/*
+ * device_data lives in a page user space can mmap() read-only (offset 0,
+ * one page) and read without a syscall, vDSO style. IOCTL_FILL_UP stays the
+ * only, capability-checked, writer and brackets its update with a sequence
+ * count: odd while the update is in progress. A reader copies the data and
+ * retries if the count was odd or changed meanwhile:
+ *
+ *     do {
+ *         while ((seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE)) & 1)
+ *             ;
+ *         snap = page->data;
+ *         __atomic_thread_fence(__ATOMIC_ACQUIRE);
+ *     } while (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) != seq);
+ */
+struct cap_shared_page {
+    __u32 seq;
+    __u32 reserved;
+    struct my_data data;
+};
+
+/* ---- /dev/mutex_demo ------------------------------------------------------ */
+
+#define MUTEX_IOCTL_BASE 'M'
+
+#define IOCTL_LOCK                  _IO(MUTEX_IOCTL_BASE, 1)
+#define IOCTL_LOCK_INTERRUPTIBLE    _IO(MUTEX_IOCTL_BASE, 2)
+#define IOCTL_LOCK_KILLABLE         _IO(MUTEX_IOCTL_BASE, 3)
+#define IOCTL_TRYLOCK               _IO(MUTEX_IOCTL_BASE, 4)
+#define IOCTL_IS_LOCKED             _IOR(MUTEX_IOCTL_BASE, 5, int)
+#define IOCTL_UNLOCK                _IO(MUTEX_IOCTL_BASE, 6)
+#define IOCTL_SET_READ_MODE         _IOW(MUTEX_IOCTL_BASE, 7, int)
+#define IOCTL_SET_RING_MODE         _IOW(MUTEX_IOCTL_BASE, 8, int)     // RING_MODE_*
+
+/*
+ * How read() gets at the shared buffer (IOCTL_SET_READ_MODE, device-wide).
+ * Writers always take the mutex; only readers differ:
+ *
+ * MUTEX_READ_MUTEX    - under the mutex, so readers serialise with each other
+ * MUTEX_READ_SEQCOUNT - lockless copy, retried if a writer ran meanwhile
+ * MUTEX_READ_RCU      - copy of the buffer the last writer published via RCU
+ */
+#define MUTEX_READ_MUTEX            0
+#define MUTEX_READ_SEQCOUNT         1
+#define MUTEX_READ_RCU              2
+
+/* ---- /dev/spinlock_dev ---------------------------------------------------- */
+
+#define SPIN_IOCTL_BASE 0xF0
+
+#define SPIN_LOCK           _IO(SPIN_IOCTL_BASE, 1)
+#define SPIN_LOCK_IRQSAVE   _IO(SPIN_IOCTL_BASE, 2)
+#define SPIN_LOCK_IRQ       _IO(SPIN_IOCTL_BASE, 3)
+#define SPIN_LOCK_BH        _IO(SPIN_IOCTL_BASE, 4)
+#define SPIN_SET_MODE       _IOW(SPIN_IOCTL_BASE, 5, int)
+#define SPIN_ADD            _IOW(SPIN_IOCTL_BASE, 6, __u64)
+#define SPIN_READ_TOTAL     _IOR(SPIN_IOCTL_BASE, 7, struct spin_total)
+
+/*
+ * The device keeps a counter: each SPIN_LOCK* command adds 1 to it under its
+ * lock variant and SPIN_ADD adds its argument. Where the update goes
+ * (SPIN_SET_MODE, device-wide):
+ *
+ * SPIN_MODE_GLOBAL  - one counter behind one global spinlock
+ * SPIN_MODE_SHARDED - one counter and spinlock per CPU, each on its own cache
+ *                     line; an update goes to the CPU it runs on
+ *
+ * SPIN_READ_TOTAL sums the global counter and every shard, so switching
+ * modes never loses updates.
+ */
+#define SPIN_MODE_GLOBAL    0
+#define SPIN_MODE_SHARDED   1
+
+struct spin_total {
+    __u64 sum;          // sum of all added values
+    __u64 updates;      // number of updates
+};
+
+/* ---- /dev/sem_variants ---------------------------------------------------- */
+
+#define SEM_IOCTL_BASE 'S'
+
+#define SEM_IOCTL_SET_POLICY    _IOW(SEM_IOCTL_BASE, 1, struct sem_policy)
+#define SEM_IOCTL_GET_POLICY    _IOR(SEM_IOCTL_BASE, 2, struct sem_policy)
+#define SEM_IOCTL_SET_SLOTS     _IOW(SEM_IOCTL_BASE, 3, int)
+#define SEM_IOCTL_GET_SLOTS     _IOR(SEM_IOCTL_BASE, 4, int)
+#define SEM_IOCTL_SET_RING      _IOW(SEM_IOCTL_BASE, 5, int)        // RING_MODE_*
+
+/*
+ * How read() and write() on this open file acquire a slot of the pool:
+ *
+ * SEM_POLICY_DOWN           - down(): waits, ignores signals
+ * SEM_POLICY_INTERRUPTIBLE  - down_interruptible(): any signal aborts the wait
+ * SEM_POLICY_KILLABLE       - down_killable(): only a fatal signal does
+ * SEM_POLICY_TRYLOCK        - down_trylock(): -EBUSY instead of waiting
+ * SEM_POLICY_TIMEOUT        - down_timeout(): -ETIME after timeout_ms
+ */
+#define SEM_POLICY_DOWN             0
+#define SEM_POLICY_INTERRUPTIBLE    1
+#define SEM_POLICY_KILLABLE         2
+#define SEM_POLICY_TRYLOCK          3
+#define SEM_POLICY_TIMEOUT          4
+
+struct sem_policy {
+    __u32 policy;           // SEM_POLICY_*
+    __u32 timeout_ms;       // SEM_POLICY_TIMEOUT only
+    __u32 hold_us;          // extra time each access keeps its slot, to emulate work
+    __u32 reserved;
+};
+
+/* ---- ring mode of /dev/mutex_demo and /dev/sem_variants ------------------ */
+
+/*
+ * What read() and write() operate on (IOCTL_SET_RING_MODE,
+ * SEM_IOCTL_SET_RING, device-wide):
+ *
+ * RING_MODE_OFF  - the shared buffer behind the driver's lock: write()
+ *                  overwrites it, read() returns it
+ * RING_MODE_SPSC - a lockless byte ring (kfifo): write() appends, read()
+ *                  drains, like a pipe. One writer and one reader at a
+ *                  time; a second concurrent one gets -EBUSY
+ * RING_MODE_MPMC - a lockless ring of messages for any number of writers
+ *                  and readers: each write() queues one message of up to
+ *                  RING_MSG_MAX bytes (longer writes are cut short), each
+ *                  read() takes one message; what does not fit in the
+ *                  read buffer is dropped
+ *
+ * In both ring modes a full ring (write) or an empty one (read) blocks, or
+ * fails with -EAGAIN on an O_NONBLOCK file. Both rings keep their contents
+ * while another mode is selected.
+ */
+#define RING_MODE_OFF       0
+#define RING_MODE_SPSC      1
+#define RING_MODE_MPMC      2
+
+#define RING_MSG_MAX        112
+
+/* ---- /dev/wait_demo ------------------------------------------------------- */
+
+#define WAIT_IOCTL_BASE 'x'
+
+#define IOCTL_DOWN_INTERRUPTIBLE    _IO(WAIT_IOCTL_BASE, 1)
+#define IOCTL_WAIT_COMPLETION       _IO(WAIT_IOCTL_BASE, 2)
+#define IOCTL_COMPLETE              _IO(WAIT_IOCTL_BASE, 3)
+#define IOCTL_WAIT_EVENT            _IO(WAIT_IOCTL_BASE, 4)
+#define IOCTL_WAKE_EVENT            _IO(WAIT_IOCTL_BASE, 5)
+#define IOCTL_WAIT_EVENT_EXCL       _IO(WAIT_IOCTL_BASE, 6)
+
+/* ---- /dev/lock_bench ------------------------------------------------------ */
+
+#define LOCK_BENCH_BASE 'L'
+
+#define IOCTL_LOCK_BENCH_RUN    _IOWR(LOCK_BENCH_BASE, 1, struct lock_bench_run)
+
+// Primitives the critical section can run under
+enum lock_bench_primitive {
+    LOCK_BENCH_SPINLOCK,
+    LOCK_BENCH_MUTEX,
+    LOCK_BENCH_SEMAPHORE,
+    LOCK_BENCH_RWSEM,
+    LOCK_BENCH_RWLOCK,
+    LOCK_BENCH_SEQLOCK,
+    LOCK_BENCH_PERCPU_RWSEM,
+    LOCK_BENCH_RCU,
+    LOCK_BENCH_NR_PRIMITIVES,
+};
+
+/*
+ * cs_loops and gap_loops above LOCK_BENCH_MAX_LOOPS are rejected with
+ * -EINVAL: under the spinning primitives the critical section runs with
+ * preemption disabled, and billions of iterations on every CPU would trip
+ * the soft-lockup, RCU-stall and hard-lockup detectors.
+ */
+#define LOCK_BENCH_MAX_LOOPS    (1 << 16)
+
+struct lock_bench_params {
+    __u32 primitive;        // enum lock_bench_primitive
+    __u32 threads;          // kthreads, pinned round-robin to the online CPUs
+    __u32 duration_ms;
+    __u32 cs_loops;         // shared cache-line accesses inside the critical section
+    __u32 gap_loops;        // cpu_relax()es between two acquisitions
+    __u32 read_pct;         // share of acquisitions taken for reading (rw primitives)
+};
+
+struct lock_bench_result {
+    __u64 ops;              // acquisitions by all threads
+    __u64 elapsed_ns;
+    __u64 acquire_ns;       // mean time from asking for the lock to holding it
+    __u64 min_thread_ops;
+    __u64 max_thread_ops;
+    __u32 fairness;         // Jain's index over per-thread ops, x1000 (1000 = fair)
+    __u32 reserved;
+};
+
+/*
+ * Runs one benchmark synchronously: the ioctl returns after duration_ms with
+ * the result filled in. Needs CAP_SYS_ADMIN; only one run at a time.
+ */
+struct lock_bench_run {
+    struct lock_bench_params params;    // in
+    struct lock_bench_result result;    // out
+};
+
+#endif /* _UAPI_CHARDEV_IOCTL_H */
@@ -7,72 +7,158 @@
 #include <linux/init.h>
 #include <linux/ioctl.h>
 #include <linux/capability.h>
+#include <linux/mutex.h>
+#include <linux/moduleparam.h>
+#include <linux/sizes.h>
+#include <linux/mm.h>
+
+#define CREATE_TRACE_POINTS
+#define CHARDEV_TRACE_SYSTEM cap_char_dev
+#include "chardev_trace.h"
+#include "chardev_stats.h"
+#include "uapi/chardev_ioctl.h"
 
 #define DEVICE_NAME "cap_char_dev"
 #define CLASS_NAME "cap_class"
 #define MEM_SIZE 4096
 
-#define IOCTL_BASE 'W'
-#define IOCTL_RETRIEVE      _IOR(IOCTL_BASE, 1, struct my_data *)
-#define IOCTL_FILL_UP       _IOW(IOCTL_BASE, 2, struct my_data *)
-#define IOCTL_SEND_TO_DEV   _IOW(IOCTL_BASE, 3, struct my_data *)
-#define IOCTL_REREAD_DEV    _IOR(IOCTL_BASE, 4, struct my_data *)
-
-struct my_data {
-    int i;
-    long x;
-    char s[100];
-};
+static unsigned int max_records = 1024;
+module_param(max_records, uint, S_IRUGO);
+MODULE_PARM_DESC(max_records, "Records the binary mode buffer can hold");
 
 static dev_t dev_num;
 static struct class *dev_class;
 static struct cdev my_cdev;
 static struct device *dev_device;
 
-static struct my_data device_data;
-static char *memory_buffer;
+static struct cap_shared_page *shared;   // holds device_data, see struct cap_shared_page
+static DEFINE_MUTEX(fill_lock);          // one FILL_UP writer at a time
+static char *memory_buffer;        // max(MEM_SIZE, binary mode image) bytes
+static size_t buffer_alloc;
 static size_t buffer_size = 0;
+static int buffer_mode = CAP_MODE_TEXT;
+static DEFINE_MUTEX(buffer_lock);  // memory_buffer, buffer_size, buffer_mode
+static struct chardev_stats stats;
+
+static inline struct cap_rec_header *rec_header(void)
+{
+    return (struct cap_rec_header *)memory_buffer;
+}
+
+static inline struct cap_record *rec_at(u32 index)
+{
+    return (struct cap_record *)(memory_buffer + sizeof(struct cap_rec_header)) + index;
+}
+
+// Empty the buffer in @mode; caller holds buffer_lock
+static void reset_buffer_locked(int mode)
+{
+    struct cap_rec_header *hdr = rec_header();
+
+    buffer_mode = mode;
+    if (mode == CAP_MODE_TEXT) {
+        memory_buffer[0] = '\0';
+        buffer_size = 0;
+        return;
+    }
+    hdr->magic = CAP_REC_MAGIC;
+    hdr->version = CAP_REC_VERSION;
+    hdr->rec_size = sizeof(struct cap_record);
+    hdr->count = 0;
+    hdr->capacity = max_records;
+    buffer_size = sizeof(*hdr);
+}
+
+// Append @rec and return its index; caller holds buffer_lock in binary mode
+static int rec_append_locked(const struct cap_record *rec)
+{
+    struct cap_rec_header *hdr = rec_header();
+
+    if (hdr->count >= hdr->capacity)
+        return -ENOSPC;
+    *rec_at(hdr->count) = *rec;
+    buffer_size += sizeof(*rec);
+    return hdr->count++;
+}
 
 static int dev_open(struct inode *inode, struct file *file)
 {
-    pr_info("Device opened\n");
+    trace_chardev_open(iminor(inode));
     return 0;
 }
 
 static int dev_release(struct inode *inode, struct file *file)
 {
-    pr_info("Device closed\n");
+    pr_debug("Device closed\n");
     return 0;
 }
 
-static ssize_t dev_read(struct file *file, char __user *buf, size_t len, loff_t *offset)
+static ssize_t do_dev_read(struct file *file, char __user *buf, size_t len, loff_t *offset)
 {
+    ssize_t ret = 0;
+
+    mutex_lock(&buffer_lock);
     if (*offset >= buffer_size)
-        return 0;
+        goto out;
 
     if (len > buffer_size - *offset)
         len = buffer_size - *offset;
 
-    if (copy_to_user(buf, memory_buffer + *offset, len))
-        return -EFAULT;
+    if (copy_to_user(buf, memory_buffer + *offset, len)) {
+        ret = -EFAULT;
+        goto out;
+    }
 
     *offset += len;
-    pr_info("Read %zu bytes\n", len);
-    return len;
+    ret = len;
+out:
+    mutex_unlock(&buffer_lock);
+    return ret;
 }
 
-static ssize_t dev_write(struct file *file, const char __user *buf, size_t len, loff_t *offset)
+static ssize_t do_dev_write(struct file *file, const char __user *buf, size_t len, loff_t *offset)
 {
+    ssize_t ret;
+
     if (len > MEM_SIZE)
         len = MEM_SIZE;
 
-    if (copy_from_user(memory_buffer, buf, len))
-        return -EFAULT;
+    mutex_lock(&buffer_lock);
+    // A raw write would corrupt the record header: binary mode only appends
+    if (buffer_mode == CAP_MODE_BINARY) {
+        ret = -EINVAL;
+    } else if (copy_from_user(memory_buffer, buf, len)) {
+        ret = -EFAULT;
+    } else {
+        buffer_size = len;
+        *offset += len;
+        ret = len;
+    }
+    mutex_unlock(&buffer_lock);
+    return ret;
+}
 
-    buffer_size = len;
-    *offset += len;
-    pr_info("Wrote %zu bytes\n", len);
-    return len;
+// Entry points: account every call in the per-CPU stats, then trace it
+static ssize_t dev_read(struct file *file, char __user *buf, size_t len, loff_t *offset)
+{
+    loff_t pos = *offset;
+    u64 start = ktime_get_ns();
+    ssize_t ret = do_dev_read(file, buf, len, offset);
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_READ, ret, start);
+
+    trace_chardev_read(pos, ret, ns);
+    return ret;
+}
+
+static ssize_t dev_write(struct file *file, const char __user *buf, size_t len, loff_t *offset)
+{
+    loff_t pos = *offset;
+    u64 start = ktime_get_ns();
+    ssize_t ret = do_dev_write(file, buf, len, offset);
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_WRITE, ret, start);
+
+    trace_chardev_write(pos, ret, ns);
+    return ret;
 }
 
 static loff_t dev_llseek(struct file *file, loff_t offset, int whence)
@@ -93,22 +179,151 @@ static loff_t dev_llseek(struct file *file, loff_t offset, int whence)
         return -EINVAL;
     }
 
-    if (new_pos < 0 || new_pos > MEM_SIZE)
+    if (new_pos < 0 || new_pos > buffer_alloc)
         return -EINVAL;
 
     file->f_pos = new_pos;
     return new_pos;
 }
 
-static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+// Consistent copy of device_data without taking fill_lock
+static void device_data_read(struct my_data *data)
+{
+    u32 seq;
+
+    do {
+        while ((seq = smp_load_acquire(&shared->seq)) & 1)
+            cpu_relax();
+        *data = shared->data;
+        smp_rmb();
+    } while (READ_ONCE(shared->seq) != seq);
+}
+
+static void device_data_write(const struct my_data *data)
+{
+    mutex_lock(&fill_lock);
+    // Readers spin while the count is odd: do not get preempted in between
+    preempt_disable();
+    WRITE_ONCE(shared->seq, shared->seq + 1);
+    // Odd count is visible before any of the new data
+    smp_wmb();
+    shared->data = *data;
+    // Pairs with the reader's acquire: the data is complete before the count turns even
+    smp_store_release(&shared->seq, shared->seq + 1);
+    preempt_enable();
+    mutex_unlock(&fill_lock);
+}
+
+static int dev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    if (vma->vm_pgoff || vma->vm_end - vma->vm_start != PAGE_SIZE)
+        return -EINVAL;
+    // Read-only, and mprotect() may not make it writable later
+    if (vma->vm_flags & VM_WRITE)
+        return -EPERM;
+    vm_flags_clear(vma, VM_MAYWRITE);
+
+    return remap_pfn_range(vma, vma->vm_start, virt_to_phys(shared) >> PAGE_SHIFT,
+                           PAGE_SIZE, vma->vm_page_prot);
+}
+
+static int send_to_dev(const struct my_data *data)
+{
+    struct cap_record rec = { .i = data->i, .x = data->x };
+    int ret = 0;
+
+    mutex_lock(&buffer_lock);
+    if (buffer_mode == CAP_MODE_TEXT) {
+        snprintf(memory_buffer, MEM_SIZE, "i=%d, x=%ld, s=%s", data->i, data->x, data->s);
+        buffer_size = strlen(memory_buffer);
+    } else {
+        memcpy(rec.s, data->s, sizeof(rec.s));
+        rec.s[sizeof(rec.s) - 1] = '\0';
+        ret = rec_append_locked(&rec);
+    }
+    mutex_unlock(&buffer_lock);
+    return ret < 0 ? ret : 0;
+}
+
+static int reread_dev(struct my_data *data)
+{
+    struct cap_record *rec;
+    int ret = 0;
+
+    mutex_lock(&buffer_lock);
+    if (buffer_mode == CAP_MODE_TEXT) {
+        sscanf(memory_buffer, "i=%d, x=%ld, s=%99s", &data->i, &data->x, data->s);
+    } else if (!rec_header()->count) {
+        ret = -ENODATA;
+    } else {
+        rec = rec_at(rec_header()->count - 1);
+        data->i = rec->i;
+        data->x = rec->x;
+        memcpy(data->s, rec->s, sizeof(data->s));
+    }
+    mutex_unlock(&buffer_lock);
+    return ret;
+}
+
+static int rec_get(struct cap_rec_get *get)
+{
+    int ret = 0;
+
+    mutex_lock(&buffer_lock);
+    if (buffer_mode != CAP_MODE_BINARY)
+        ret = -EINVAL;
+    else if (get->index >= rec_header()->count)
+        ret = -ENOENT;
+    else
+        get->rec = *rec_at(get->index);
+    mutex_unlock(&buffer_lock);
+    return ret;
+}
+
+// Copy up to range->count records starting at range->first; returns the number copied
+static int rec_get_range(struct cap_rec_range *range)
+{
+    u32 count;
+    int ret;
+
+    mutex_lock(&buffer_lock);
+    if (buffer_mode != CAP_MODE_BINARY) {
+        ret = -EINVAL;
+        goto out;
+    }
+    count = rec_header()->count;
+    if (range->first > count) {
+        ret = -ENOENT;
+        goto out;
+    }
+    count = min(range->count, count - range->first);
+    // One copy for the whole run: records are contiguous in the buffer
+    if (copy_to_user(u64_to_user_ptr(range->addr), rec_at(range->first),
+                     (size_t)count * sizeof(struct cap_record))) {
+        ret = -EFAULT;
+        goto out;
+    }
+    range->count = count;
+    ret = count;
+out:
+    mutex_unlock(&buffer_lock);
+    return ret;
+}
+
+static long do_dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
     struct my_data temp;
+    struct cap_record rec;
+    struct cap_rec_get get;
+    struct cap_rec_range range;
+    int mode, ret;
 
     switch (cmd) {
     case IOCTL_RETRIEVE:
-        if (copy_to_user((struct my_data *)arg, &device_data, sizeof(struct my_data)))
+        device_data_read(&temp);
+        if (copy_to_user((struct my_data *)arg, &temp, sizeof(struct my_data)))
             return -EFAULT;
-        pr_info("IOCTL: Retrieve data\n");
+        pr_debug("IOCTL: Retrieve data\n");
         break;
 
     case IOCTL_FILL_UP:
@@ -118,8 +333,8 @@ static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
         if (copy_from_user(&temp, (struct my_data *)arg, sizeof(struct my_data)))
             return -EFAULT;
 
-        device_data = temp;
-        pr_info("IOCTL: Fill up data\n");
+        device_data_write(&temp);
+        pr_debug("IOCTL: Fill up data\n");
         break;
 
     case IOCTL_SEND_TO_DEV:
@@ -129,18 +344,70 @@ static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
         if (copy_from_user(&temp, (struct my_data *)arg, sizeof(struct my_data)))
             return -EFAULT;
 
-        snprintf(memory_buffer, MEM_SIZE, "i=%d, x=%ld, s=%s", temp.i, temp.x, temp.s);
-        buffer_size = strlen(memory_buffer);
-        pr_info("IOCTL: Sent to device\n");
+        ret = send_to_dev(&temp);
+        if (ret)
+            return ret;
+        pr_debug("IOCTL: Sent to device\n");
         break;
 
     case IOCTL_REREAD_DEV:
-        sscanf(memory_buffer, "i=%d, x=%ld, s=%99s", &temp.i, &temp.x, temp.s);
+        memset(&temp, 0, sizeof(temp));
+        ret = reread_dev(&temp);
+        if (ret)
+            return ret;
         if (copy_to_user((struct my_data *)arg, &temp, sizeof(struct my_data)))
             return -EFAULT;
-        pr_info("IOCTL: Reread device data\n");
+        pr_debug("IOCTL: Reread device data\n");
         break;
 
+    case IOCTL_SET_MODE:
+        if (!capable(CAP_SYS_ADMIN))
+            return -EPERM;
+
+        if (copy_from_user(&mode, (int __user *)arg, sizeof(int)))
+            return -EFAULT;
+        if (mode != CAP_MODE_TEXT && mode != CAP_MODE_BINARY)
+            return -EINVAL;
+
+        mutex_lock(&buffer_lock);
+        reset_buffer_locked(mode);
+        mutex_unlock(&buffer_lock);
+        pr_debug("IOCTL: Buffer mode %d\n", mode);
+        break;
+
+    case IOCTL_REC_APPEND:
+        if (!capable(CAP_SYS_ADMIN))
+            return -EPERM;
+
+        if (copy_from_user(&rec, (struct cap_record __user *)arg, sizeof(rec)))
+            return -EFAULT;
+        rec.s[sizeof(rec.s) - 1] = '\0';
+
+        mutex_lock(&buffer_lock);
+        ret = buffer_mode == CAP_MODE_BINARY ? rec_append_locked(&rec) : -EINVAL;
+        mutex_unlock(&buffer_lock);
+        return ret;     // index of the new record
+
+    case IOCTL_REC_GET:
+        if (copy_from_user(&get, (struct cap_rec_get __user *)arg, sizeof(get)))
+            return -EFAULT;
+        ret = rec_get(&get);
+        if (ret)
+            return ret;
+        if (copy_to_user((struct cap_rec_get __user *)arg, &get, sizeof(get)))
+            return -EFAULT;
+        break;
+
+    case IOCTL_REC_GET_RANGE:
+        if (copy_from_user(&range, (struct cap_rec_range __user *)arg, sizeof(range)))
+            return -EFAULT;
+        ret = rec_get_range(&range);
+        if (ret < 0)
+            return ret;
+        if (put_user(range.count, &((struct cap_rec_range __user *)arg)->count))
+            return -EFAULT;
+        return ret;
+
     default:
         return -EINVAL;
     }
@@ -148,6 +415,17 @@ static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
     return 0;
 }
 
+static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    u64 start = ktime_get_ns();
+    long ret = do_dev_ioctl(file, cmd, arg);
+    // Record indexes and counts are not bytes moved: account them as success only
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_IOCTL, min(ret, 0L), start);
+
+    trace_chardev_ioctl(cmd, ret, ns);
+    return ret;
+}
+
 static struct file_operations fops = {
     .owner = THIS_MODULE,
     .open = dev_open,
@@ -156,16 +434,41 @@ static struct file_operations fops = {
     .write = dev_write,
     .unlocked_ioctl = dev_ioctl,
     .llseek = dev_llseek,
+    .mmap = dev_mmap,
 };
 
 static int __init mod_init(void)
 {
     int ret;
 
-    ret = alloc_chrdev_region(&dev_num, 0, 1, DEVICE_NAME);
+    if (!max_records || max_records > SZ_1M)
+        return -EINVAL;
+    BUILD_BUG_ON(sizeof(struct cap_shared_page) > PAGE_SIZE);
+
+    // Stats must exist before the device node can be opened
+    ret = chardev_stats_init(&stats, DEVICE_NAME);
     if (ret)
         return ret;
 
+    // Likewise the buffers: cdev_add() makes the node live
+    buffer_alloc = max_t(size_t, MEM_SIZE,
+                         sizeof(struct cap_rec_header) + array_size(max_records, sizeof(struct cap_record)));
+    memory_buffer = kvzalloc(buffer_alloc, GFP_KERNEL);
+    if (!memory_buffer) {
+        ret = -ENOMEM;
+        goto r_mem;
+    }
+
+    shared = (struct cap_shared_page *)get_zeroed_page(GFP_KERNEL);
+    if (!shared) {
+        ret = -ENOMEM;
+        goto r_shared;
+    }
+
+    ret = alloc_chrdev_region(&dev_num, 0, 1, DEVICE_NAME);
+    if (ret)
+        goto r_region;
+
     cdev_init(&my_cdev, &fops);
     ret = cdev_add(&my_cdev, dev_num, 1);
     if (ret)
@@ -183,33 +486,34 @@ static int __init mod_init(void)
         goto r_device;
     }
 
-    memory_buffer = kmalloc(MEM_SIZE, GFP_KERNEL);
-    if (!memory_buffer) {
-        ret = -ENOMEM;
-        goto r_mem;
-    }
-
     pr_info("Driver loaded: %s\n", DEVICE_NAME);
     return 0;
 
-r_mem:
-    device_destroy(dev_class, dev_num);
 r_device:
     class_destroy(dev_class);
 r_class:
     cdev_del(&my_cdev);
 r_cdev:
     unregister_chrdev_region(dev_num, 1);
+r_region:
+    free_page((unsigned long)shared);
+r_shared:
+    kvfree(memory_buffer);
+r_mem:
+    chardev_stats_exit(&stats);
     return ret;
 }
 
 static void __exit mod_exit(void)
 {
-    kfree(memory_buffer);
     device_destroy(dev_class, dev_num);
     class_destroy(dev_class);
     cdev_del(&my_cdev);
     unregister_chrdev_region(dev_num, 1);
+    // A live mapping holds the module, so nobody can still be reading the page
+    free_page((unsigned long)shared);
+    kvfree(memory_buffer);
+    chardev_stats_exit(&stats);
     pr_info("Driver unloaded: %s\n", DEVICE_NAME);
 }
 
@@ -3,111 +3,993 @@
 #include <linux/kernel.h>
 #include <linux/fs.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/splice.h>
 #include <linux/cdev.h>
 #include <linux/device.h>
 #include <linux/slab.h>
 #include <linux/ioctl.h>
+#include <linux/moduleparam.h>
+#include <linux/srcu.h>
+#include <linux/rwsem.h>
+#include <linux/sizes.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/cpu.h>
+#include <linux/poll.h>
+#include <linux/file.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/io_uring/cmd.h>
+
+#define CREATE_TRACE_POINTS
+#define CHARDEV_TRACE_SYSTEM dynamic_ioctl_dev
+#include "chardev_trace.h"
+#include "chardev_stats.h"
+#include "chardev_range_lock.h"
+#include "uapi/chardev_ioctl.h"
 
 #define DEVICE_NAME "dynamic_ioctl_dev"
-#define IOCTL_BASE 'D'
 
-#define IOCTL_FILL_ZERO _IO(IOCTL_BASE, 1)
-#define IOCTL_FILL_CHAR _IOW(IOCTL_BASE, 2, char)
-#define IOCTL_SET_SIZE  _IOW(IOCTL_BASE, 3, int)
-#define IOCTL_GET_SIZE  _IOR(IOCTL_BASE, 4, int)
-#define IOCTL_MAX_CMDS  _IOR(IOCTL_BASE, 5, int)
+#define IOCTL_NR_CMDS   8        // reported by IOCTL_MAX_CMDS
 
-#define MAX_MEMORY_SIZE 4000
+#define MAX_MEMORY_SIZE (4UL << 30)   // largest size SET_SIZE or buffer_size= may ask for
 
 static dev_t dev_num;
 static struct class *dev_class;
 static struct cdev my_cdev;
 
-static char *device_buffer;
-static size_t buffer_size = 1024;
+/*
+ * The buffer is a table of chunks, each a zeroed folio (or a vmalloc area
+ * when memory is too fragmented for a high-order folio). Chunks are allocated
+ * on first write, so memory follows the data written rather than the size,
+ * and never-written ranges read as zeros. The chunk size is the buffer size
+ * rounded up to a power of two, clamped to [PAGE_SIZE, 1 << CHUNK_MAX_SHIFT].
+ *
+ * The table is replaced, never resized in place: a resize builds a new table,
+ * moves the chunk pointers across (copying data only when the chunk size
+ * changes, i.e. below the largest chunk size) and publishes it with
+ * rcu_assign_pointer(). Readers only take an SRCU read lock (SRCU rather than
+ * RCU because copy_to_iter() may fault and sleep), so a resize never blocks
+ * them. Chunks past a shrunken end are freed with the old table once the last
+ * reader that could see it has left, which returns the memory to the system.
+ *
+ * Writers modify chunks in place, so they hold resize_sem shared and a resize
+ * holds it exclusive: no write can land in a table already moved.
+ *
+ * Within a table, every access also holds a byte-range lock on the bytes it
+ * touches (chardev_range_lock.h): pwrite()s to disjoint ranges and all
+ * readers run in parallel, while overlapping writes are serialised and a
+ * read never sees a write half done. Lock order: resize_sem, then ranges.
+ */
+#define CHUNK_MAX_SHIFT 21      // 2 MiB: PMD-sized folios on x86-64
+
+struct dev_buffer {
+    size_t size;
+    unsigned int chunk_shift;
+    unsigned long nr_chunks;
+    unsigned long nr_moved;     // chunks [0, nr_moved) now belong to a newer table
+    atomic_long_t resident;     // bytes of populated chunks
+    struct rcu_head rcu;        // deferred free after a batched resize
+    void *chunks[];
+};
+
+static struct dev_buffer __rcu *device_buffer;
+DEFINE_STATIC_SRCU(buffer_srcu);
+static DECLARE_RWSEM(resize_sem);
+static struct chardev_range_tree ranges;    // byte ranges being read or written
+static struct chardev_stats stats;
+
+/*
+ * Both parameters can be changed on a loaded module:
+ *     echo 65536 > /sys/module/dynamic_ioctl_char_dev/parameters/buffer_size
+ *     echo 7 > /sys/module/dynamic_ioctl_char_dev/parameters/log_level
+ */
+static unsigned long buffer_size = 1024;     // mirrors device_buffer->size
+static int log_level = LOGLEVEL_INFO;
+
+// Messages above log_level are dropped before any formatting work
+#define dev_log(level, fmt, ...)                                  \
+    do {                                                          \
+        if (unlikely((level) <= READ_ONCE(log_level)))            \
+            pr_info(fmt, ##__VA_ARGS__);                          \
+    } while (0)
+
+static int resize_buffer(size_t size);
+
+static int buffer_size_set(const char *val, const struct kernel_param *kp)
+{
+    unsigned long size;
+    int ret = kstrtoul(val, 0, &size);
+
+    if (ret)
+        return ret;
+    if (!size || size > MAX_MEMORY_SIZE)
+        return -EINVAL;
+    // At load time only record the size: char_dev_init() allocates the buffer
+    if (!rcu_access_pointer(device_buffer)) {
+        buffer_size = size;
+        return 0;
+    }
+    return resize_buffer(size);
+}
+
+static const struct kernel_param_ops buffer_size_ops = {
+    .set = buffer_size_set,
+    .get = param_get_ulong,
+};
+module_param_cb(buffer_size, &buffer_size_ops, &buffer_size, 0644);
+MODULE_PARM_DESC(buffer_size, "Buffer size in bytes; writing it resizes the live buffer");
+
+static int log_level_set(const char *val, const struct kernel_param *kp)
+{
+    int level;
+    int ret = kstrtoint(val, 0, &level);
+
+    if (ret)
+        return ret;
+    if (level < LOGLEVEL_EMERG || level > LOGLEVEL_DEBUG)
+        return -EINVAL;
+    WRITE_ONCE(log_level, level);
+    return 0;
+}
+
+static const struct kernel_param_ops log_level_ops = {
+    .set = log_level_set,
+    .get = param_get_int,
+};
+module_param_cb(log_level, &log_level_ops, &log_level, 0644);
+MODULE_PARM_DESC(log_level, "0-7 like printk levels; 7 logs every command");
 
 static int dev_open(struct inode *inode, struct file *file)
 {
-    pr_info("Device opened\n");
+    // Reads and writes only wait for a resize or an overlapping range; IOCB_NOWAIT ones never do
+    file->f_mode |= FMODE_NOWAIT;
+    trace_chardev_open(iminor(inode));
     return 0;
 }
 
 static int dev_release(struct inode *inode, struct file *file)
 {
-    pr_info("Device closed\n");
+    dev_log(LOGLEVEL_DEBUG, "Device closed\n");
     return 0;
 }
 
-static ssize_t dev_read(struct file *file, char __user *user_buf, size_t len, loff_t *offset)
+static inline size_t chunk_size(const struct dev_buffer *buf)
+{
+    return 1UL << buf->chunk_shift;
+}
+
+static void *chunk_alloc(unsigned int shift, gfp_t gfp)
 {
-    if (*offset >= buffer_size)
+    struct folio *folio;
+
+    // High orders fail fast instead of reclaiming hard: vmalloc is the fallback
+    folio = folio_alloc(gfp | __GFP_ZERO | __GFP_NOWARN | (shift > PAGE_SHIFT ? __GFP_NORETRY : 0),
+                        shift - PAGE_SHIFT);
+    if (folio)
+        return folio_address(folio);
+    if (shift > PAGE_SHIFT && gfpflags_allow_blocking(gfp))
+        return vzalloc(1UL << shift);
+    return NULL;
+}
+
+static void chunk_free(void *chunk)
+{
+    if (is_vmalloc_addr(chunk))
+        vfree(chunk);
+    else
+        folio_put(virt_to_folio(chunk));
+}
+
+// Chunk @idx, or NULL for a hole that reads as zeros
+static inline char *chunk_peek(struct dev_buffer *buf, unsigned long idx)
+{
+    // Pairs with the cmpxchg() that published the zeroed chunk
+    return smp_load_acquire(&buf->chunks[idx]);
+}
+
+// Chunk @idx, allocated on first use; caller holds resize_sem or owns @buf
+static char *chunk_get(struct dev_buffer *buf, unsigned long idx, gfp_t gfp)
+{
+    char *chunk = chunk_peek(buf, idx);
+    void *old;
+
+    if (chunk)
+        return chunk;
+    chunk = chunk_alloc(buf->chunk_shift, gfp);
+    if (!chunk)
+        return ERR_PTR(gfpflags_allow_blocking(gfp) ? -ENOMEM : -EAGAIN);
+
+    // Writers hold resize_sem shared, so two may populate the same hole: first one wins
+    old = cmpxchg(&buf->chunks[idx], NULL, chunk);
+    if (old) {
+        chunk_free(chunk);
+        return old;
+    }
+    atomic_long_add(chunk_size(buf), &buf->resident);
+    return chunk;
+}
+
+static struct dev_buffer *alloc_buffer(size_t size)
+{
+    unsigned int shift = clamp_t(unsigned int, order_base_2(size), PAGE_SHIFT, CHUNK_MAX_SHIFT);
+    unsigned long nr = DIV_ROUND_UP(size, 1UL << shift);
+    struct dev_buffer *buf = kvzalloc(struct_size(buf, chunks, nr), GFP_KERNEL);
+
+    if (!buf)
+        return NULL;
+    buf->size = size;
+    buf->chunk_shift = shift;
+    buf->nr_chunks = nr;
+    return buf;
+}
+
+// Free @buf and the chunks it still owns
+static void free_buffer(struct dev_buffer *buf)
+{
+    unsigned long i;
+
+    for (i = buf->nr_moved; i < buf->nr_chunks; i++)
+        if (buf->chunks[i])
+            chunk_free(buf->chunks[i]);
+    kvfree(buf);
+}
+
+static void free_buffer_rcu(struct rcu_head *rcu)
+{
+    free_buffer(container_of(rcu, struct dev_buffer, rcu));
+}
+
+/*
+ * Give @new the contents of @old, truncated or zero-extended; caller holds
+ * resize_sem exclusive. With equal chunk sizes the chunks move and no data is
+ * copied; @old keeps, and later frees, only the chunks past the new end.
+ */
+static int transfer_buffer_locked(struct dev_buffer *old, struct dev_buffer *new)
+{
+    size_t keep = min(old->size, new->size);
+    size_t pos, step, tail;
+    unsigned long i, nr;
+    char *src, *dst;
+
+    if (old->chunk_shift == new->chunk_shift) {
+        nr = DIV_ROUND_UP(keep, chunk_size(new));
+        for (i = 0; i < nr; i++) {
+            new->chunks[i] = old->chunks[i];
+            if (new->chunks[i])
+                atomic_long_add(chunk_size(new), &new->resident);
+        }
+        old->nr_moved = nr;
+
+        // Growing: the old last chunk may hold bytes from before an earlier shrink
+        tail = old->size & (chunk_size(old) - 1);
+        if (new->size > old->size && tail && new->chunks[nr - 1])
+            memset((char *)new->chunks[nr - 1] + tail, 0, chunk_size(new) - tail);
         return 0;
-    if (*offset + len > buffer_size)
-        len = buffer_size - *offset;
+    }
 
-    if (copy_to_user(user_buf, device_buffer + *offset, len))
-        return -EFAULT;
+    // Power-of-two steps of the smaller chunk size never straddle a chunk in either table
+    step = 1UL << min(old->chunk_shift, new->chunk_shift);
+    for (pos = 0; pos < keep; pos += step) {
+        src = chunk_peek(old, pos >> old->chunk_shift);
+        if (!src)
+            continue;
+        dst = chunk_get(new, pos >> new->chunk_shift, GFP_KERNEL);
+        if (IS_ERR(dst))
+            return PTR_ERR(dst);
+        memcpy(dst + (pos & (chunk_size(new) - 1)), src + (pos & (chunk_size(old) - 1)),
+               min(step, keep - pos));
+    }
+    return 0;
+}
 
-    *offset += len;
-    pr_info("Read %zu bytes\n", len);
-    return len;
+// Make @new the live buffer; caller holds resize_sem exclusive
+static void publish_buffer_locked(struct dev_buffer *new)
+{
+    rcu_assign_pointer(device_buffer, new);
+    WRITE_ONCE(buffer_size, new->size);
+    dev_log(LOGLEVEL_INFO, "Buffer resized to %zu bytes, %ld resident\n",
+            new->size, atomic_long_read(&new->resident));
 }
 
-static ssize_t dev_write(struct file *file, const char __user *user_buf, size_t len, loff_t *offset)
+/*
+ * Swap in a buffer of @size bytes holding the old contents (truncated or
+ * zero-extended). Sleeps: waits for writers and for readers of the old buffer.
+ */
+static int resize_buffer(size_t size)
 {
-    if (*offset >= buffer_size)
+    struct dev_buffer *old, *new;
+    int ret;
+
+    if (!size || size > MAX_MEMORY_SIZE)
+        return -EINVAL;
+
+    // Allocate the table before taking the lock so writers are held off only for the move
+    new = alloc_buffer(size);
+    if (!new)
+        return -ENOMEM;
+
+    down_write(&resize_sem);
+    old = rcu_dereference_protected(device_buffer, lockdep_is_held(&resize_sem));
+    if (!old) {
+        // Module is being unloaded
+        up_write(&resize_sem);
+        free_buffer(new);
+        return -ENODEV;
+    }
+    ret = transfer_buffer_locked(old, new);
+    if (ret) {
+        up_write(&resize_sem);
+        free_buffer(new);
+        return ret;
+    }
+    publish_buffer_locked(new);
+    up_write(&resize_sem);
+
+    synchronize_srcu(&buffer_srcu);
+    free_buffer(old);
+    return 0;
+}
+
+// Copy out of @buf at @pos; holes read as zeros. Caller holds SRCU or resize_sem.
+static ssize_t buf_read(struct dev_buffer *buf, loff_t pos, struct iov_iter *to)
+{
+    size_t len = iov_iter_count(to), done = 0;
+
+    if (pos >= buf->size)
+        return 0;
+    len = min_t(size_t, len, buf->size - pos);
+
+    while (done < len) {
+        size_t off = pos & (chunk_size(buf) - 1);
+        size_t n = min(len - done, chunk_size(buf) - off);
+        char *chunk = chunk_peek(buf, pos >> buf->chunk_shift);
+        size_t copied = chunk ? copy_to_iter(chunk + off, n, to) : iov_iter_zero(n, to);
+
+        done += copied;
+        pos += copied;
+        if (copied < n)
+            break;
+    }
+    if (done || !len)
+        return done;
+    return -EFAULT;
+}
+
+// Copy into @buf at @pos, populating chunks with @gfp. Caller holds resize_sem shared.
+static ssize_t buf_write(struct dev_buffer *buf, loff_t pos, struct iov_iter *from, gfp_t gfp)
+{
+    size_t len = iov_iter_count(from), done = 0;
+    ssize_t err = -EFAULT;
+
+    if (pos >= buf->size)
         return -ENOSPC;
-    if (*offset + len > buffer_size)
-        len = buffer_size - *offset;
+    len = min_t(size_t, len, buf->size - pos);
+
+    while (done < len) {
+        size_t off = pos & (chunk_size(buf) - 1);
+        size_t n = min(len - done, chunk_size(buf) - off);
+        char *chunk = chunk_get(buf, pos >> buf->chunk_shift, gfp);
+        size_t copied;
+
+        if (IS_ERR(chunk)) {
+            err = PTR_ERR(chunk);
+            break;
+        }
+        copied = copy_from_iter(chunk + off, n, from);
+        done += copied;
+        pos += copied;
+        if (copied < n)
+            break;
+    }
+    if (done || !len)
+        return done;
+    return err;
+}
+
+// buf_read() under a read lock on the bytes it will copy; @nowait never sleeps for it
+static ssize_t range_read(struct dev_buffer *buf, loff_t pos, struct iov_iter *to, bool nowait)
+{
+    struct chardev_range r;
+    size_t len;
+    ssize_t ret;
+
+    if (pos >= buf->size || !iov_iter_count(to))
+        return 0;
+    len = min_t(size_t, iov_iter_count(to), buf->size - pos);
+
+    if (nowait)
+        ret = chardev_range_trylock(&ranges, &r, pos, pos + len - 1, false);
+    else
+        ret = chardev_range_lock(&ranges, &r, pos, pos + len - 1, false);
+    if (ret)
+        return ret;
+    ret = buf_read(buf, pos, to);
+    chardev_range_unlock(&ranges, &r);
+    return ret;
+}
+
+// buf_write() under a write lock on the bytes it will copy; never sleeps for it without @gfp blocking
+static ssize_t range_write(struct dev_buffer *buf, loff_t pos, struct iov_iter *from, gfp_t gfp)
+{
+    struct chardev_range r;
+    size_t len;
+    ssize_t ret;
+
+    if (pos >= buf->size)
+        return -ENOSPC;
+    if (!iov_iter_count(from))
+        return 0;
+    len = min_t(size_t, iov_iter_count(from), buf->size - pos);
+
+    if (gfpflags_allow_blocking(gfp))
+        ret = chardev_range_lock(&ranges, &r, pos, pos + len - 1, true);
+    else
+        ret = chardev_range_trylock(&ranges, &r, pos, pos + len - 1, true);
+    if (ret)
+        return ret;
+    ret = buf_write(buf, pos, from, gfp);
+    chardev_range_unlock(&ranges, &r);
+    return ret;
+}
+
+/*
+ * read_iter/write_iter serve read()/write(), readv()/writev() and io_uring:
+ * a whole iovec array is handled in one call instead of one per fragment.
+ */
+static ssize_t do_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    ssize_t ret;
+    int idx;
+
+    idx = srcu_read_lock(&buffer_srcu);
+    ret = range_read(srcu_dereference(device_buffer, &buffer_srcu), iocb->ki_pos, to,
+                     iocb->ki_flags & IOCB_NOWAIT);
+    srcu_read_unlock(&buffer_srcu, idx);
+
+    if (ret > 0)
+        iocb->ki_pos += ret;
+    return ret;
+}
+
+static ssize_t do_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    bool nowait = iocb->ki_flags & IOCB_NOWAIT;
+    struct dev_buffer *buf;
+    ssize_t ret;
+
+    if (nowait) {
+        if (!down_read_trylock(&resize_sem))
+            return -EAGAIN;
+    } else {
+        down_read(&resize_sem);
+    }
+    buf = rcu_dereference_protected(device_buffer, lockdep_is_held(&resize_sem));
+    ret = range_write(buf, iocb->ki_pos, from, nowait ? GFP_NOWAIT : GFP_KERNEL);
+    up_read(&resize_sem);
+
+    if (ret > 0)
+        iocb->ki_pos += ret;
+    return ret;
+}
+
+// Entry points: account every call in the per-CPU stats, then trace it
+static ssize_t dev_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    loff_t pos = iocb->ki_pos;
+    u64 start = ktime_get_ns();
+    ssize_t ret = do_read_iter(iocb, to);
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_READ, ret, start);
+
+    trace_chardev_read(pos, ret, ns);
+    return ret;
+}
+
+static ssize_t dev_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    loff_t pos = iocb->ki_pos;
+    u64 start = ktime_get_ns();
+    ssize_t ret = do_write_iter(iocb, from);
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_WRITE, ret, start);
+
+    trace_chardev_write(pos, ret, ns);
+    return ret;
+}
+
+/*
+ * Fill engine. A fill of at least FILL_PARALLEL_MIN bytes is split into spans
+ * of whole chunks, one per CPU (up to fill_threads), that run from a
+ * CPU-intensive workqueue; zero fills skip holes, which already read as
+ * zeros. A fill larger than the last-level cache uses non-temporal stores on
+ * x86: its data would be evicted long before anyone reads it, so streaming it
+ * past the cache keeps other tasks' lines resident.
+ *
+ * IOCTL_FILL_ASYNC returns as soon as the spans are queued. poll() reports
+ * EPOLLPRI while no asynchronous fill issued through that open file is in
+ * flight, so waiting for one's own fill is
+ *     ioctl(fd, IOCTL_FILL_ASYNC, &c); poll({fd, POLLPRI}, 1, -1);
+ * Only one async fill runs at a time device-wide (others get -EBUSY), and the
+ * issuing file stays pinned until it finishes.
+ * The fill holds resize_sem shared and a write lock on the whole byte range
+ * until it finishes, so a resize, and reads and writes, wait for it.
+ */
+#define FILL_PARALLEL_MIN   SZ_1M
+
+static unsigned int fill_threads;
+module_param(fill_threads, uint, 0644);
+MODULE_PARM_DESC(fill_threads, "Max CPUs used by one fill (0 = all online CPUs)");
+
+static unsigned long nt_threshold;
+module_param(nt_threshold, ulong, 0644);
+MODULE_PARM_DESC(nt_threshold, "Fills larger than this use non-temporal stores (0 = LLC size)");
+
+static struct workqueue_struct *fill_wq;
+static DECLARE_WAIT_QUEUE_HEAD(fill_waitq);     // poll() waiters for async fills
+static struct file *fill_async_file;            // issuer of the async fill in flight
+
+struct fill_job;
+
+struct fill_span {
+    struct work_struct work;
+    struct fill_job *job;
+    unsigned long first;       // chunk range [first, last)
+    unsigned long last;
+};
+
+struct fill_job {
+    struct dev_buffer *buf;
+    char c;
+    int err;                   // last chunk allocation failure, if any
+    bool nt;                   // use streaming stores
+    bool async;                // finish by releasing resize_sem, not completing @done
+    struct file *file;         // async only: the issuing file, pinned until done
+    atomic_t pending;          // spans still running
+    struct completion done;
+    struct chardev_range range;    // async only: the whole buffer, write-locked
+    unsigned int nr_spans;
+    struct fill_span spans[];
+};
+
+#ifdef CONFIG_X86_64
+// movnti writes around the cache; the caller fences with wmb() (sfence)
+static void fill_bytes_nt(char *p, char c, size_t len)
+{
+    u64 v = 0x0101010101010101ULL * (u8)c;
+    size_t head = min_t(size_t, len, -(unsigned long)p & 7);
+
+    memset(p, c, head);
+    p += head;
+    len -= head;
+    for (; len >= 32; p += 32, len -= 32)
+        asm volatile("movnti %1, (%0)\n\t"
+                     "movnti %1, 8(%0)\n\t"
+                     "movnti %1, 16(%0)\n\t"
+                     "movnti %1, 24(%0)"
+                     : : "r" (p), "r" (v) : "memory");
+    for (; len >= 8; p += 8, len -= 8)
+        asm volatile("movnti %1, (%0)" : : "r" (p), "r" (v) : "memory");
+    memset(p, c, len);
+}
+
+static unsigned long llc_bytes(void)
+{
+    // x86_cache_size is in KB, or -1 when CPUID did not report it
+    return boot_cpu_data.x86_cache_size > 0 ? boot_cpu_data.x86_cache_size * 1024UL : SZ_32M;
+}
+#else
+#define fill_bytes_nt(p, c, len) memset(p, c, len)
+
+static unsigned long llc_bytes(void)
+{
+    return ULONG_MAX;          // no streaming stores here: never switch to them
+}
+#endif
+
+static void fill_bytes(char *p, char c, size_t len, bool nt)
+{
+    if (nt)
+        fill_bytes_nt(p, c, len);
+    else
+        memset(p, c, len);
+}
+
+/*
+ * Fill chunks [first, last) of @buf; caller holds resize_sem. Holes are
+ * populated with @gfp: without __GFP_DIRECT_RECLAIM the fill never sleeps and
+ * stops at the first chunk it cannot allocate, returning -EAGAIN.
+ */
+static int fill_chunks(struct dev_buffer *buf, unsigned long first, unsigned long last,
+                       char c, bool nt, gfp_t gfp)
+{
+    bool can_sleep = gfpflags_allow_blocking(gfp);
+    unsigned long i;
+    int ret = 0;
+
+    for (i = first; i < last; i++) {
+        size_t len = min_t(size_t, chunk_size(buf), buf->size - ((size_t)i << buf->chunk_shift));
+        char *chunk = c ? chunk_get(buf, i, gfp) : chunk_peek(buf, i);
+
+        if (IS_ERR(chunk)) {
+            ret = PTR_ERR(chunk);
+            if (!can_sleep)
+                break;
+        } else if (chunk) {
+            fill_bytes(chunk, c, len, nt);
+        }
+        if (can_sleep)
+            cond_resched();
+    }
+    // Streaming stores are weakly ordered: drain them before reporting completion
+    if (nt)
+        wmb();
+    return ret;
+}
+
+static void fill_job_done(struct fill_job *job)
+{
+    struct file *file = job->file;
+
+    if (!job->async) {
+        complete(&job->done);
+        return;
+    }
+    chardev_range_unlock(&ranges, &job->range);
+    up_read_non_owner(&resize_sem);
+    if (job->err)
+        pr_warn("Async fill incomplete: %d\n", job->err);
+    kfree(job);
+    WRITE_ONCE(fill_async_file, NULL);
+    wake_up_interruptible(&fill_waitq);
+    fput(file);
+    dev_log(LOGLEVEL_DEBUG, "Async fill done\n");
+}
+
+static void fill_span_work(struct work_struct *work)
+{
+    struct fill_span *span = container_of(work, struct fill_span, work);
+    struct fill_job *job = span->job;
+    int ret = fill_chunks(job->buf, span->first, span->last, job->c, job->nt, GFP_KERNEL);
+
+    if (ret)
+        WRITE_ONCE(job->err, ret);
+    if (atomic_dec_and_test(&job->pending))
+        fill_job_done(job);
+}
+
+static struct fill_job *fill_job_alloc(struct dev_buffer *buf, char c, bool async)
+{
+    unsigned int threads = READ_ONCE(fill_threads) ?: num_online_cpus();
+    unsigned long nt_min = READ_ONCE(nt_threshold) ?: llc_bytes();
+    unsigned long nr = clamp_t(unsigned long, buf->size / FILL_PARALLEL_MIN, 1,
+                               min_t(unsigned long, threads, buf->nr_chunks));
+    unsigned long per_span = DIV_ROUND_UP(buf->nr_chunks, nr);
+    struct fill_job *job;
+    unsigned int i;
+
+    // Rounding up the chunks per span can leave the last spans empty: drop them
+    nr = DIV_ROUND_UP(buf->nr_chunks, per_span);
+    job = kzalloc(struct_size(job, spans, nr), GFP_KERNEL);
+    if (!job)
+        return NULL;
+
+    job->buf = buf;
+    job->c = c;
+    job->nt = buf->size > nt_min;
+    job->async = async;
+    init_completion(&job->done);
+    for (i = 0; i < nr; i++) {
+        struct fill_span *span = &job->spans[i];
+
+        span->job = job;
+        span->first = i * per_span;
+        span->last = min(span->first + per_span, buf->nr_chunks);
+        INIT_WORK(&span->work, fill_span_work);
+    }
+    job->nr_spans = nr;
+    atomic_set(&job->pending, nr);
+    return job;
+}
+
+// Queue one span per online CPU, round robin from the first one
+static void fill_job_start(struct fill_job *job)
+{
+    unsigned int i, cpu;
+
+    cpus_read_lock();
+    cpu = cpumask_first(cpu_online_mask);
+    for (i = 0; i < job->nr_spans; i++) {
+        queue_work_on(cpu, fill_wq, &job->spans[i].work);
+        cpu = cpumask_next(cpu, cpu_online_mask);
+        if (cpu >= nr_cpu_ids)
+            cpu = cpumask_first(cpu_online_mask);
+    }
+    cpus_read_unlock();
+}
+
+// Fill all of @buf with @c and wait; the caller holds resize_sem. @nowait never sleeps.
+static int fill_locked(struct dev_buffer *buf, char c, bool nowait)
+{
+    struct fill_job *job = NULL;
+    struct chardev_range r;
+    int ret;
+
+    if (nowait)
+        ret = chardev_range_trylock(&ranges, &r, 0, buf->size - 1, true);
+    else
+        ret = chardev_range_lock(&ranges, &r, 0, buf->size - 1, true);
+    if (ret)
+        return ret;
+
+    if (buf->size >= FILL_PARALLEL_MIN)
+        job = fill_job_alloc(buf, c, false);
+    if (job) {
+        fill_job_start(job);
+        wait_for_completion(&job->done);
+        ret = job->err;
+        kfree(job);
+    } else {
+        // Small fill, or no memory for a job: do it here on one CPU
+        ret = fill_chunks(buf, 0, buf->nr_chunks, c, false,
+                          nowait ? GFP_NOWAIT : GFP_KERNEL);
+    }
+
+    chardev_range_unlock(&ranges, &r);
+    return ret;
+}
+
+// Command bodies shared by the ioctl() and io_uring paths; @nowait never sleeps
+static int fill_buffer(char fill, bool nowait)
+{
+    struct dev_buffer *buf;
+    int ret;
+
+    if (nowait) {
+        if (!down_read_trylock(&resize_sem))
+            return -EAGAIN;
+    } else {
+        down_read(&resize_sem);
+    }
+    buf = rcu_dereference_protected(device_buffer, lockdep_is_held(&resize_sem));
+    // A parallel fill waits for its workers: let io_uring retry it from io-wq
+    if (nowait && buf->size >= FILL_PARALLEL_MIN) {
+        up_read(&resize_sem);
+        return -EAGAIN;
+    }
+    ret = fill_locked(buf, fill, nowait);
+    up_read(&resize_sem);
+
+    dev_log(LOGLEVEL_DEBUG, "Filled with char 0x%02x\n", (unsigned char)fill);
+    return ret;
+}
+
+static int fill_buffer_async(struct file *file, char fill)
+{
+    struct dev_buffer *buf;
+    struct fill_job *job;
+    int ret = -ENOMEM;
+
+    if (cmpxchg(&fill_async_file, NULL, file))
+        return -EBUSY;
+
+    // Released by the last span's worker, hence the non-owner variants
+    down_read_non_owner(&resize_sem);
+    buf = rcu_dereference_protected(device_buffer, 1);
+    job = fill_job_alloc(buf, fill, true);
+    if (!job)
+        goto err;
+    job->file = get_file(file);
+    // Waits here for overlapping accesses; the issuer may be killed meanwhile
+    ret = chardev_range_lock(&ranges, &job->range, 0, buf->size - 1, true);
+    if (ret) {
+        fput(job->file);
+        kfree(job);
+        goto err;
+    }
+    fill_job_start(job);
+    return 0;
+
+err:
+    up_read_non_owner(&resize_sem);
+    WRITE_ONCE(fill_async_file, NULL);
+    wake_up_interruptible(&fill_waitq);
+    return ret;
+}
+
+static __poll_t dev_poll(struct file *file, poll_table *wait)
+{
+    __poll_t mask = EPOLLIN | EPOLLRDNORM | EPOLLOUT | EPOLLWRNORM;
+
+    // The wait queue is device-wide; only this file's own fill clears EPOLLPRI
+    poll_wait(file, &fill_waitq, wait);
+    if (READ_ONCE(fill_async_file) != file)
+        mask |= EPOLLPRI;
+    return mask;
+}
+
+static int set_buffer_size(long size, bool nowait)
+{
+    if (size <= 0 || size > MAX_MEMORY_SIZE)
+        return -EINVAL;
+    // A resize waits for an SRCU grace period
+    if (nowait)
+        return -EAGAIN;
+    return resize_buffer(size);
+}
+
+// Run one batch entry; resize_sem is held, exclusive if @exclusive
+static long batch_entry(struct dynamic_ioctl_batch_entry *e, bool exclusive)
+{
+    struct dev_buffer *buf = rcu_dereference_protected(device_buffer, lockdep_is_held(&resize_sem));
+    void __user *ubuf = u64_to_user_ptr(e->addr);
+    struct dev_buffer *new;
+    struct iov_iter iter;
+    long ret;
+
+    switch (e->cmd) {
+        case IOCTL_FILL_ZERO:
+            return fill_locked(buf, 0, false);
+
+        case IOCTL_FILL_CHAR:
+            return fill_locked(buf, (char)e->arg, false);
+
+        case IOCTL_SET_SIZE:
+            if (!exclusive)
+                return -EINVAL;
+            if (!e->arg || e->arg > MAX_MEMORY_SIZE)
+                return -EINVAL;
+            new = alloc_buffer(e->arg);
+            if (!new)
+                return -ENOMEM;
+            ret = transfer_buffer_locked(buf, new);
+            if (ret) {
+                free_buffer(new);
+                return ret;
+            }
+            publish_buffer_locked(new);
+            // Cannot wait for readers while holding the lock: free the old one later
+            call_srcu(&buffer_srcu, &buf->rcu, free_buffer_rcu);
+            return 0;
+
+        case IOCTL_GET_SIZE:
+            return min_t(size_t, buf->size, INT_MAX);
 
-    if (copy_from_user(device_buffer + *offset, user_buf, len))
+        case IOCTL_MAX_CMDS:
+            return IOCTL_NR_CMDS;
+
+        // import_ubuf() caps the length at MAX_RW_COUNT, so the byte count fits @result
+        case BATCH_OP_READ:
+            if (e->offset >= buf->size)
+                return 0;
+            ret = import_ubuf(ITER_DEST, ubuf, e->len, &iter);
+            return ret ?: range_read(buf, e->offset, &iter, false);
+
+        case BATCH_OP_WRITE:
+            if (e->offset >= buf->size)
+                return -ENOSPC;
+            ret = import_ubuf(ITER_SOURCE, ubuf, e->len, &iter);
+            return ret ?: range_write(buf, e->offset, &iter, GFP_KERNEL);
+
+        default:
+            return -EINVAL;
+    }
+}
+
+static long dev_ioctl_batch(struct dynamic_ioctl_batch __user *ubatch)
+{
+    struct dynamic_ioctl_batch_entry *entries;
+    struct dynamic_ioctl_batch batch;
+    bool exclusive = false;
+    long ret = 0;
+    u32 i, done;
+
+    if (copy_from_user(&batch, ubatch, sizeof(batch)))
         return -EFAULT;
+    if (!batch.count || batch.count > BATCH_MAX_ENTRIES || batch.flags & ~BATCH_STOP_ON_ERROR)
+        return -EINVAL;
+
+    entries = memdup_array_user(u64_to_user_ptr(batch.entries), batch.count, sizeof(*entries));
+    if (IS_ERR(entries))
+        return PTR_ERR(entries);
+
+    // Only a batch that resizes needs to shut out other writers
+    for (i = 0; i < batch.count; i++)
+        if (entries[i].cmd == IOCTL_SET_SIZE)
+            exclusive = true;
 
-    *offset += len;
-    pr_info("Wrote %zu bytes\n", len);
-    return len;
+    if (exclusive)
+        down_write(&resize_sem);
+    else
+        down_read(&resize_sem);
+
+    for (done = 0; done < batch.count; done++) {
+        struct dynamic_ioctl_batch_entry *e = &entries[done];
+
+        e->result = batch_entry(e, exclusive);
+        if (e->result < 0 && (batch.flags & BATCH_STOP_ON_ERROR)) {
+            done++;
+            break;
+        }
+    }
+
+    if (exclusive)
+        up_write(&resize_sem);
+    else
+        up_read(&resize_sem);
+
+    for (i = done; i < batch.count; i++)
+        entries[i].result = -ECANCELED;
+
+    if (copy_to_user(u64_to_user_ptr(batch.entries), entries, batch.count * sizeof(*entries)))
+        ret = -EFAULT;
+    kvfree(entries);
+    dev_log(LOGLEVEL_DEBUG, "Batch ran %u of %u entries\n", done, batch.count);
+    return ret ? ret : done;
 }
 
-static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+static void get_usage(struct dynamic_ioctl_usage *usage)
 {
+    struct dev_buffer *buf;
+    int idx;
+
+    idx = srcu_read_lock(&buffer_srcu);
+    buf = srcu_dereference(device_buffer, &buffer_srcu);
+    usage->size = buf->size;
+    usage->resident = atomic_long_read(&buf->resident);
+    srcu_read_unlock(&buffer_srcu, idx);
+}
+
+static long do_dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct dynamic_ioctl_usage usage;
     int tmp;
     char fill;
 
     switch (cmd) {
         case IOCTL_FILL_ZERO:
-            memset(device_buffer, 0, buffer_size);
-            pr_info("Filled with zeros\n");
-            break;
+            return fill_buffer(0, false);
 
         case IOCTL_FILL_CHAR:
             if (copy_from_user(&fill, (char __user *)arg, sizeof(char)))
                 return -EFAULT;
-            memset(device_buffer, fill, buffer_size);
-            pr_info("Filled with char '%c'\n", fill);
-            break;
+            return fill_buffer(fill, false);
+
+        case IOCTL_FILL_ASYNC:
+            if (copy_from_user(&fill, (char __user *)arg, sizeof(char)))
+                return -EFAULT;
+            return fill_buffer_async(file, fill);
 
         case IOCTL_SET_SIZE:
             if (copy_from_user(&tmp, (int __user *)arg, sizeof(int)))
                 return -EFAULT;
-            if (tmp <= 0 || tmp > MAX_MEMORY_SIZE)
-                return -EINVAL;
-            buffer_size = tmp;
-            pr_info("Buffer size set to %d bytes\n", tmp);
-            break;
+            return set_buffer_size(tmp, false);
 
         case IOCTL_GET_SIZE:
-            if (copy_to_user((int __user *)arg, &buffer_size, sizeof(int)))
+            tmp = min_t(unsigned long, READ_ONCE(buffer_size), INT_MAX);
+            if (copy_to_user((int __user *)arg, &tmp, sizeof(int)))
+                return -EFAULT;
+            dev_log(LOGLEVEL_DEBUG, "Returned buffer size %d\n", tmp);
+            break;
+
+        case IOCTL_GET_USAGE:
+            get_usage(&usage);
+            if (copy_to_user((void __user *)arg, &usage, sizeof(usage)))
                 return -EFAULT;
-            pr_info("Returned buffer size %zu\n", buffer_size);
+            dev_log(LOGLEVEL_DEBUG, "Returned size %llu, resident %llu\n", usage.size, usage.resident);
             break;
 
         case IOCTL_MAX_CMDS:
-            tmp = 5;
+            tmp = IOCTL_NR_CMDS;
             if (copy_to_user((int __user *)arg, &tmp, sizeof(int)))
                 return -EFAULT;
-            pr_info("Returned max command count: %d\n", tmp);
+            dev_log(LOGLEVEL_DEBUG, "Returned max command count: %d\n", tmp);
             break;
 
+        case IOCTL_BATCH:
+            return dev_ioctl_batch((struct dynamic_ioctl_batch __user *)arg);
+
         default:
             return -EINVAL;
     }
@@ -115,8 +997,65 @@ static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
     return 0;
 }
 
+static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    u64 start = ktime_get_ns();
+    long ret = do_dev_ioctl(file, cmd, arg);
+    // A batch returns its entry count: account that as success, not bytes
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_IOCTL, min(ret, 0L), start);
+
+    trace_chardev_ioctl(cmd, ret, ns);
+    return ret;
+}
+
+/*
+ * Commands complete inline at issue time and the return value becomes
+ * cqe->res. Under IO_URING_F_NONBLOCK anything that would sleep (a fill racing
+ * a resize, or SET_SIZE itself) returns -EAGAIN and io_uring retries it from
+ * io-wq, where blocking is allowed.
+ */
+static int do_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags)
+{
+    bool nowait = issue_flags & IO_URING_F_NONBLOCK;
+    const struct dynamic_ioctl_uring_pdu *pdu = io_uring_sqe_cmd(ioucmd->sqe);
+    // The SQE is shared with user space: read the argument exactly once
+    u64 arg = READ_ONCE(pdu->arg);
+
+    switch (ioucmd->cmd_op) {
+        case IOCTL_FILL_ZERO:
+            return fill_buffer(0, nowait);
+
+        case IOCTL_FILL_CHAR:
+            return fill_buffer((char)arg, nowait);
+
+        case IOCTL_SET_SIZE:
+            return set_buffer_size(arg > MAX_MEMORY_SIZE ? -1 : (long)arg, nowait);
+
+        case IOCTL_GET_SIZE:
+            return min_t(unsigned long, READ_ONCE(buffer_size), INT_MAX);
+
+        case IOCTL_MAX_CMDS:
+            return IOCTL_NR_CMDS;
+
+        default:
+            return -EINVAL;
+    }
+}
+
+static int dev_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags)
+{
+    u64 start = ktime_get_ns();
+    int ret = do_uring_cmd(ioucmd, issue_flags);
+    // Positive results are values, not bytes moved: account them as success only
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_IOCTL, min(ret, 0), start);
+
+    trace_chardev_ioctl(ioucmd->cmd_op, ret, ns);
+    return ret;
+}
+
 static loff_t dev_llseek(struct file *file, loff_t offset, int whence)
 {
+    loff_t size = READ_ONCE(buffer_size);
     loff_t new_pos;
 
     switch (whence) {
@@ -127,17 +1066,17 @@ static loff_t dev_llseek(struct file *file, loff_t offset, int whence)
             new_pos = file->f_pos + offset;
             break;
         case SEEK_END:
-            new_pos = buffer_size + offset;
+            new_pos = size + offset;
             break;
         default:
             return -EINVAL;
     }
 
-    if (new_pos < 0 || new_pos > buffer_size)
+    if (new_pos < 0 || new_pos > size)
         return -EINVAL;
 
     file->f_pos = new_pos;
-    pr_info("Seek to %lld\n", new_pos);
+    dev_log(LOGLEVEL_DEBUG, "Seek to %lld\n", new_pos);
     return new_pos;
 }
 
@@ -145,16 +1084,34 @@ static struct file_operations fops = {
     .owner = THIS_MODULE,
     .open = dev_open,
     .release = dev_release,
-    .read = dev_read,
-    .write = dev_write,
+    .read_iter = dev_read_iter,
+    .write_iter = dev_write_iter,
+    // splice()/tee()/sendfile() move data pipe <-> buffer inside the kernel
+    .splice_read = copy_splice_read,
+    .splice_write = iter_file_splice_write,
     .llseek = dev_llseek,
-    .unlocked_ioctl = dev_ioctl
+    .poll = dev_poll,
+    .unlocked_ioctl = dev_ioctl,
+    .uring_cmd = dev_uring_cmd
 };
 
 static int __init char_dev_init(void)
 {
+    struct dev_buffer *buf;
+
+    chardev_range_tree_init(&ranges);
+
+    // Stats must exist before the device node can be opened
+    if (chardev_stats_init(&stats, DEVICE_NAME))
+        return -ENOMEM;
+
+    // Fill spans are long CPU-bound work items: keep them out of the concurrency limit
+    fill_wq = alloc_workqueue("dynamic_ioctl_fill", WQ_CPU_INTENSIVE, 0);
+    if (!fill_wq)
+        goto r_wq;
+
     if (alloc_chrdev_region(&dev_num, 0, 1, DEVICE_NAME) < 0)
-        return -1;
+        goto r_region;
 
     cdev_init(&my_cdev, &fops);
 
@@ -168,9 +1125,11 @@ static int __init char_dev_init(void)
     if (device_create(dev_class, NULL, dev_num, NULL, DEVICE_NAME) == NULL)
         goto r_device;
 
-    device_buffer = kzalloc(MAX_MEMORY_SIZE, GFP_KERNEL);
-    if (!device_buffer)
+    // Only the chunk table: chunks are populated by the first write to them
+    buf = alloc_buffer(buffer_size);
+    if (!buf)
         goto r_alloc;
+    rcu_assign_pointer(device_buffer, buf);
 
     pr_info("Dynamic IOCTL Char Driver Loaded: Major=%d Minor=%d\n",
             MAJOR(dev_num), MINOR(dev_num));
@@ -184,16 +1143,35 @@ r_class:
     cdev_del(&my_cdev);
 r_cdev:
     unregister_chrdev_region(dev_num, 1);
+r_region:
+    destroy_workqueue(fill_wq);
+r_wq:
+    chardev_stats_exit(&stats);
     return -1;
 }
 
 static void __exit char_dev_exit(void)
 {
-    kfree(device_buffer);
+    struct dev_buffer *buf;
+
+    /*
+     * The parameter files outlive exit(): leave a racing resize nothing to
+     * swap. Taking resize_sem exclusive also waits out an async fill.
+     */
+    down_write(&resize_sem);
+    buf = rcu_replace_pointer(device_buffer, NULL, lockdep_is_held(&resize_sem));
+    up_write(&resize_sem);
+    free_buffer(buf);
+    // Buffers retired by batched resizes are freed from SRCU callbacks
+    srcu_barrier(&buffer_srcu);
+
     device_destroy(dev_class, dev_num);
     class_destroy(dev_class);
     cdev_del(&my_cdev);
     unregister_chrdev_region(dev_num, 1);
+    // Flushes the tail of the last async span (after it dropped resize_sem)
+    destroy_workqueue(fill_wq);
+    chardev_stats_exit(&stats);
     pr_info("Dynamic IOCTL Char Driver Removed\n");
 }
 
@@ -0,0 +1,126 @@
+/* Runs a fill / write / read / query sequence on /dev/dynamic_ioctl_dev as separate
+syscalls and as one IOCTL_BATCH, checks both give the same data, and times them.
+
+Each iteration does:
+    FILL_CHAR '#', WRITE 16 bytes at 0, WRITE 16 bytes at 512, READ 16 bytes at 0,
+    READ 16 bytes at 512, GET_SIZE
+i.e. 6 syscalls one at a time, or 1 syscall batched.
+
+Build: gcc -O2 -o bench_batch_ioctl bench_batch_ioctl.c
+Usage: ./bench_batch_ioctl [-d device] [-n iterations]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+#include "../../include/uapi/chardev_ioctl.h"
+
+#define DEFAULT_DEVICE "/dev/dynamic_ioctl_dev"
+
+#define SEG 16
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char wr_a[SEG], wr_b[SEG], rd_a[SEG], rd_b[SEG];
+
+static int run_single(int fd) {
+    char fill = '#';
+    int size;
+
+    if (ioctl(fd, IOCTL_FILL_CHAR, &fill) < 0 ||
+        pwrite(fd, wr_a, SEG, 0) != SEG ||
+        pwrite(fd, wr_b, SEG, 512) != SEG ||
+        pread(fd, rd_a, SEG, 0) != SEG ||
+        pread(fd, rd_b, SEG, 512) != SEG ||
+        ioctl(fd, IOCTL_GET_SIZE, &size) < 0)
+        return -1;
+    return size;
+}
+
+static int run_batch(int fd) {
+    struct dynamic_ioctl_batch_entry e[] = {
+        { .cmd = IOCTL_FILL_CHAR, .arg = '#' },
+        { .cmd = BATCH_OP_WRITE, .offset = 0,   .len = SEG, .addr = (uintptr_t)wr_a },
+        { .cmd = BATCH_OP_WRITE, .offset = 512, .len = SEG, .addr = (uintptr_t)wr_b },
+        { .cmd = BATCH_OP_READ,  .offset = 0,   .len = SEG, .addr = (uintptr_t)rd_a },
+        { .cmd = BATCH_OP_READ,  .offset = 512, .len = SEG, .addr = (uintptr_t)rd_b },
+        { .cmd = IOCTL_GET_SIZE },
+    };
+    struct dynamic_ioctl_batch b = {
+        .entries = (uintptr_t)e,
+        .count = sizeof(e) / sizeof(e[0]),
+        .flags = BATCH_STOP_ON_ERROR,
+    };
+    int n = ioctl(fd, IOCTL_BATCH, &b);
+
+    if (n != (int)b.count) {
+        for (int i = 0; i < (int)b.count; i++)
+            if (e[i].result < 0)
+                fprintf(stderr, "batch entry %d: %s\n", i, strerror(-e[i].result));
+        return -1;
+    }
+    return e[5].result;
+}
+
+int main(int argc, char *argv[]) {
+    const char *device = DEFAULT_DEVICE;
+    unsigned long n = 200000;
+    double start, single, batched;
+    int fd, opt, size;
+
+    while ((opt = getopt(argc, argv, "d:n:")) != -1) {
+        switch (opt) {
+        case 'd': device = optarg; break;
+        case 'n': n = strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "Usage: %s [-d device] [-n iterations]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    fd = open(device, O_RDWR);
+    if (fd < 0) {
+        perror("open device");
+        return 1;
+    }
+    memset(wr_a, 'A', SEG);
+    memset(wr_b, 'B', SEG);
+
+    // Correctness first: the batch must observe the same data as the single calls
+    size = run_batch(fd);
+    if (size < 0 || memcmp(rd_a, wr_a, SEG) || memcmp(rd_b, wr_b, SEG)) {
+        fprintf(stderr, "batch result mismatch\n");
+        return 1;
+    }
+    printf("IOCTL_BATCH ok: buffer size %d, segments read back\n", size);
+
+    start = now_sec();
+    for (unsigned long i = 0; i < n; i++)
+        if (run_single(fd) < 0) {
+            perror("single");
+            return 1;
+        }
+    single = now_sec() - start;
+
+    start = now_sec();
+    for (unsigned long i = 0; i < n; i++)
+        if (run_batch(fd) < 0)
+            return 1;
+    batched = now_sec() - start;
+
+    printf("%-8s %10s %14s\n", "mode", "syscalls", "ns/sequence");
+    printf("%-8s %10d %14.0f\n", "single", 6, single * 1e9 / n);
+    printf("%-8s %10d %14.0f\n", "batch", 1, batched * 1e9 / n);
+
+    close(fd);
+    return 0;
+}
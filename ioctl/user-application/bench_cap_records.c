@@ -0,0 +1,180 @@
+/* Compares the text and binary record modes of /dev/cap_char_dev in records/s.
+
+    text         SEND_TO_DEV (kernel snprintf) + REREAD_DEV (kernel sscanf)
+    binary       SEND_TO_DEV (append) + REREAD_DEV (newest record), same calls
+    binary-get   REC_APPEND + REC_GET by index
+    binary-range REC_APPEND of a whole buffer, then REC_GET_RANGE in one call
+    binary-read  REC_APPEND of a whole buffer, then one read() of the image
+
+It first checks that a string with spaces survives the binary mode intact
+(text mode cuts it at the first space). Appending needs CAP_SYS_ADMIN.
+
+Build: gcc -O2 -o bench_cap_records bench_cap_records.c
+Usage: sudo ./bench_cap_records [-d device] [-n records]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+#include "../../include/uapi/chardev_ioctl.h"
+
+#define DEFAULT_DEVICE "/dev/cap_char_dev"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int set_mode(int fd, int mode) {
+    return ioctl(fd, IOCTL_SET_MODE, &mode);
+}
+
+static void die(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+static void report(const char *mode, unsigned long n, double sec) {
+    printf("%-14s %10lu %14.0f %12.0f\n", mode, n, n / sec, sec * 1e9 / n);
+}
+
+// SEND_TO_DEV + REREAD_DEV per record in @mode
+static double run_roundtrip(int fd, int mode, unsigned long n, unsigned int capacity) {
+    struct my_data in = { .x = 1234567890L }, out;
+    double start;
+
+    strcpy(in.s, "record_payload");
+    if (set_mode(fd, mode) < 0)
+        die("IOCTL_SET_MODE");
+    start = now_sec();
+    for (unsigned long k = 0; k < n; k++) {
+        // Binary mode appends: start over when the buffer is full
+        if (mode == CAP_MODE_BINARY && k % capacity == 0 && k && set_mode(fd, mode) < 0)
+            die("IOCTL_SET_MODE");
+        in.i = k;
+        if (ioctl(fd, IOCTL_SEND_TO_DEV, &in) < 0)
+            die("IOCTL_SEND_TO_DEV");
+        if (ioctl(fd, IOCTL_REREAD_DEV, &out) < 0)
+            die("IOCTL_REREAD_DEV");
+        if (out.i != in.i)
+            fprintf(stderr, "record %lu read back as %d\n", k, out.i);
+    }
+    return now_sec() - start;
+}
+
+static double run_get(int fd, unsigned long n, unsigned int capacity) {
+    struct cap_record rec = { .x = 1234567890L };
+    struct cap_rec_get get = { 0 };
+    double start;
+    int idx;
+
+    strcpy(rec.s, "record_payload");
+    start = now_sec();
+    for (unsigned long k = 0; k < n; k++) {
+        if (k % capacity == 0 && set_mode(fd, CAP_MODE_BINARY) < 0)
+            die("IOCTL_SET_MODE");
+        rec.i = k;
+        idx = ioctl(fd, IOCTL_REC_APPEND, &rec);
+        if (idx < 0)
+            die("IOCTL_REC_APPEND");
+        get.index = idx;
+        if (ioctl(fd, IOCTL_REC_GET, &get) < 0)
+            die("IOCTL_REC_GET");
+    }
+    return now_sec() - start;
+}
+
+// Fill the whole buffer, then fetch it back in bulk with REC_GET_RANGE or read()
+static double run_bulk(int fd, unsigned long n, unsigned int capacity, int use_read) {
+    size_t image = sizeof(struct cap_rec_header) + (size_t)capacity * sizeof(struct cap_record);
+    char *buf = malloc(image);
+    struct cap_record rec = { .x = 1234567890L };
+    double start;
+
+    if (!buf)
+        die("malloc");
+    strcpy(rec.s, "record_payload");
+    start = now_sec();
+    for (unsigned long k = 0; k < n; k += capacity) {
+        unsigned int batch = n - k < capacity ? n - k : capacity;
+
+        if (set_mode(fd, CAP_MODE_BINARY) < 0)
+            die("IOCTL_SET_MODE");
+        for (unsigned int j = 0; j < batch; j++) {
+            rec.i = k + j;
+            if (ioctl(fd, IOCTL_REC_APPEND, &rec) < 0)
+                die("IOCTL_REC_APPEND");
+        }
+        if (use_read) {
+            if (pread(fd, buf, image, 0) < (ssize_t)sizeof(struct cap_rec_header))
+                die("read");
+        } else {
+            struct cap_rec_range range = { .first = 0, .count = batch, .addr = (uintptr_t)buf };
+
+            if (ioctl(fd, IOCTL_REC_GET_RANGE, &range) != (int)batch)
+                die("IOCTL_REC_GET_RANGE");
+        }
+    }
+    free(buf);
+    return now_sec() - start;
+}
+
+int main(int argc, char *argv[]) {
+    const char *device = DEFAULT_DEVICE;
+    unsigned long n = 200000;
+    struct cap_rec_header hdr;
+    struct my_data in = { .i = 7, .x = -42 }, out;
+    int fd, opt;
+
+    while ((opt = getopt(argc, argv, "d:n:")) != -1) {
+        switch (opt) {
+        case 'd': device = optarg; break;
+        case 'n': n = strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "Usage: %s [-d device] [-n records]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    fd = open(device, O_RDWR);
+    if (fd < 0)
+        die("open device");
+
+    // The header tells us the layout and the capacity
+    if (set_mode(fd, CAP_MODE_BINARY) < 0)
+        die("IOCTL_SET_MODE (need CAP_SYS_ADMIN)");
+    if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || hdr.magic != CAP_REC_MAGIC ||
+        hdr.rec_size != sizeof(struct cap_record) || !hdr.capacity) {
+        fprintf(stderr, "unexpected binary header\n");
+        return 1;
+    }
+    printf("binary mode: version %u, %u-byte records, capacity %u\n",
+           hdr.version, hdr.rec_size, hdr.capacity);
+
+    strcpy(in.s, "a string with spaces");
+    for (int mode = CAP_MODE_TEXT; mode <= CAP_MODE_BINARY; mode++) {
+        memset(&out, 0, sizeof(out));
+        if (set_mode(fd, mode) < 0 || ioctl(fd, IOCTL_SEND_TO_DEV, &in) < 0 ||
+            ioctl(fd, IOCTL_REREAD_DEV, &out) < 0)
+            die("round trip");
+        printf("%-6s round trip: i=%d x=%ld s=\"%s\"\n",
+               mode == CAP_MODE_TEXT ? "text" : "binary", out.i, out.x, out.s);
+    }
+
+    printf("\n%-14s %10s %14s %12s\n", "mode", "records", "records/s", "ns/record");
+    report("text", n, run_roundtrip(fd, CAP_MODE_TEXT, n, hdr.capacity));
+    report("binary", n, run_roundtrip(fd, CAP_MODE_BINARY, n, hdr.capacity));
+    report("binary-get", n, run_get(fd, n, hdr.capacity));
+    report("binary-range", n, run_bulk(fd, n, hdr.capacity, 0));
+    report("binary-read", n, run_bulk(fd, n, hdr.capacity, 1));
+
+    set_mode(fd, CAP_MODE_TEXT);
+    close(fd);
+    return 0;
+}
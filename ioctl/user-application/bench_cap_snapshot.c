@@ -0,0 +1,140 @@
+/* Reads device_data of /dev/cap_char_dev through IOCTL_RETRIEVE and through the
+read-only mmap() page, and compares snapshots per second.
+
+With -w a writer thread keeps updating the data with IOCTL_FILL_UP (needs
+CAP_SYS_ADMIN), writing records whose fields all encode the same counter,
+and every snapshot is checked for tearing.
+
+Build: gcc -O2 -pthread -o bench_cap_snapshot bench_cap_snapshot.c
+Usage: [sudo] ./bench_cap_snapshot [-d device] [-n snapshots] [-w]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/types.h>
+#include "../../include/uapi/chardev_ioctl.h"
+
+#define DEFAULT_DEVICE "/dev/cap_char_dev"
+
+static volatile int stop;
+static int fd;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Lock-free snapshot: retry while an update is in progress or raced with the copy
+static unsigned long snapshot(const struct cap_shared_page *page, struct my_data *snap) {
+    unsigned long retries = 0;
+    __u32 seq;
+
+    for (;;) {
+        while ((seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE)) & 1)
+            ;
+        memcpy(snap, (const void *)&page->data, sizeof(*snap));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq)
+            return retries;
+        retries++;
+    }
+}
+
+static int torn(const struct my_data *d) {
+    char s[sizeof(d->s)];
+
+    snprintf(s, sizeof(s), "value %d", d->i);
+    return d->x != (long)d->i * 3 || strcmp(s, d->s);
+}
+
+static void *writer(void *unused) {
+    struct my_data d;
+
+    (void)unused;
+    for (int i = 1; !stop; i++) {
+        memset(&d, 0, sizeof(d));
+        d.i = i;
+        d.x = (long)i * 3;
+        snprintf(d.s, sizeof(d.s), "value %d", i);
+        if (ioctl(fd, IOCTL_FILL_UP, &d) < 0) {
+            perror("IOCTL_FILL_UP (need CAP_SYS_ADMIN)");
+            break;
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    const char *device = DEFAULT_DEVICE;
+    unsigned long n = 1000000, bad = 0, retries = 0;
+    const struct cap_shared_page *page;
+    struct my_data d;
+    pthread_t tid;
+    int opt, with_writer = 0;
+    double start, t_ioctl, t_mmap;
+
+    while ((opt = getopt(argc, argv, "d:n:w")) != -1) {
+        switch (opt) {
+        case 'd': device = optarg; break;
+        case 'n': n = strtoul(optarg, NULL, 0); break;
+        case 'w': with_writer = 1; break;
+        default:
+            fprintf(stderr, "Usage: %s [-d device] [-n snapshots] [-w]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    fd = open(device, O_RDONLY);
+    if (fd < 0) {
+        perror("open device");
+        return 1;
+    }
+    page = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+    if (page == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    if (with_writer && pthread_create(&tid, NULL, writer, NULL)) {
+        perror("pthread_create");
+        return 1;
+    }
+
+    start = now_sec();
+    for (unsigned long k = 0; k < n; k++) {
+        if (ioctl(fd, IOCTL_RETRIEVE, &d) < 0) {
+            perror("IOCTL_RETRIEVE");
+            return 1;
+        }
+        bad += with_writer && d.i && torn(&d);
+    }
+    t_ioctl = now_sec() - start;
+
+    start = now_sec();
+    for (unsigned long k = 0; k < n; k++) {
+        retries += snapshot(page, &d);
+        bad += with_writer && d.i && torn(&d);
+    }
+    t_mmap = now_sec() - start;
+
+    if (with_writer) {
+        stop = 1;
+        pthread_join(tid, NULL);
+    }
+
+    printf("%-8s %12s %12s\n", "path", "snapshots/s", "ns/snapshot");
+    printf("%-8s %12.0f %12.1f\n", "ioctl", n / t_ioctl, t_ioctl * 1e9 / n);
+    printf("%-8s %12.0f %12.1f\n", "mmap", n / t_mmap, t_mmap * 1e9 / n);
+    printf("last: i=%d x=%ld s=\"%s\", mmap retries %lu, torn snapshots %lu\n",
+           d.i, d.x, d.s, retries, bad);
+
+    munmap((void *)page, sysconf(_SC_PAGESIZE));
+    close(fd);
+    return bad ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+/* Measures IOCTL_FILL_CHAR throughput of /dev/dynamic_ioctl_dev versus buffer size and
+fill thread count, plus the IOCTL_FILL_ASYNC return and completion times.
+
+For every size the buffer is resized with IOCTL_SET_SIZE (sizes the driver
+refuses are skipped), then the fill_threads module parameter is stepped
+through 1, 2, 4 ... CPUs. Writing the parameter needs root. The driver
+populates its buffer lazily, so the first fill of each size also pays for the
+allocation; IOCTL_GET_USAGE shows how much of it is resident before and after.
+
+Streaming (non-temporal) stores kick in above the LLC size; to compare
+without them:
+    echo 18446744073709551615 > /sys/module/dynamic_ioctl_char_dev/parameters/nt_threshold
+
+Build: gcc -O2 -o bench_fill bench_fill.c
+Usage: sudo ./bench_fill [-d device] [-r repeats] [-m max_bytes]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/types.h>
+#include "../../include/uapi/chardev_ioctl.h"
+
+#define DEFAULT_DEVICE "/dev/dynamic_ioctl_dev"
+#define FILL_THREADS   "/sys/module/dynamic_ioctl_char_dev/parameters/fill_threads"
+
+static unsigned long long resident_kb(int fd) {
+    struct dynamic_ioctl_usage u;
+
+    return ioctl(fd, IOCTL_GET_USAGE, &u) < 0 ? 0 : u.resident >> 10;
+}
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int set_threads(unsigned int n) {
+    FILE *f = fopen(FILL_THREADS, "w");
+
+    if (!f)
+        return -1;
+    fprintf(f, "%u\n", n);
+    return fclose(f);
+}
+
+// 1, 2, 4 ... and finally exactly @max
+static long next_threads(long t, long max) {
+    if (t == max)
+        return max + 1;
+    return t * 2 < max ? t * 2 : max;
+}
+
+int main(int argc, char *argv[]) {
+    const char *device = DEFAULT_DEVICE;
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long max = 1UL << 30;
+    int repeats = 5, fd, opt;
+    char c = 'x';
+
+    while ((opt = getopt(argc, argv, "d:r:m:")) != -1) {
+        switch (opt) {
+        case 'd': device = optarg; break;
+        case 'r': repeats = atoi(optarg); break;
+        case 'm': max = strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "Usage: %s [-d device] [-r repeats] [-m max_bytes]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    fd = open(device, O_RDWR);
+    if (fd < 0) {
+        perror("open device");
+        return 1;
+    }
+    if (set_threads(1) < 0) {
+        perror(FILL_THREADS);
+        return 1;
+    }
+
+    printf("%12s %8s %10s %14s %14s\n", "size", "threads", "GB/s", "async_ret_us", "async_done_us");
+    for (unsigned long size = 1UL << 20; size <= max && size <= (1UL << 30); size <<= 2) {
+        int isize = size;
+
+        if (ioctl(fd, IOCTL_SET_SIZE, &isize) < 0) {
+            printf("%12lu  (size refused by driver, skipped)\n", size);
+            continue;
+        }
+        printf("%12lu  resident %llu KB after resize\n", size, resident_kb(fd));
+
+        for (long t = 1; t <= ncpus; t = next_threads(t, ncpus)) {
+            struct pollfd pfd = { .fd = fd, .events = POLLPRI };
+            double start, elapsed, ret_at, done_at;
+
+            set_threads(t);
+            ioctl(fd, IOCTL_FILL_CHAR, &c);     // warm up: fault in, spin up workers
+
+            start = now_sec();
+            for (int r = 0; r < repeats; r++)
+                if (ioctl(fd, IOCTL_FILL_CHAR, &c) < 0) {
+                    perror("IOCTL_FILL_CHAR");
+                    return 1;
+                }
+            elapsed = now_sec() - start;
+
+            // Async: how fast the ioctl returns, and when poll() reports completion
+            start = now_sec();
+            if (ioctl(fd, IOCTL_FILL_ASYNC, &c) < 0) {
+                perror("IOCTL_FILL_ASYNC");
+                return 1;
+            }
+            ret_at = now_sec() - start;
+            poll(&pfd, 1, -1);
+            done_at = now_sec() - start;
+
+            printf("%12lu %8ld %10.2f %14.1f %14.1f\n", size, t,
+                   (double)size * repeats / elapsed / 1e9, ret_at * 1e6, done_at * 1e6);
+        }
+        printf("%12lu  resident %llu KB after fills\n", size, resident_kb(fd));
+    }
+
+    set_threads(0);
+    close(fd);
+    return 0;
+}
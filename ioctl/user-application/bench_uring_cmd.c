@@ -0,0 +1,110 @@
+/* Compares plain ioctl() with batched io_uring URING_CMD submissions
+
+For each batch size, issues -n commands against /dev/dynamic_ioctl_dev:
+    ioctl      : one syscall per command
+    uring_cmd  : @batch SQEs per io_uring_enter(), completions reaped from the CQ
+
+IOCTL_GET_SIZE is the default command (no buffer work, so syscall overhead
+dominates); -c fill uses IOCTL_FILL_CHAR to show the case where work dominates.
+
+Build: gcc -O2 -o bench_uring_cmd bench_uring_cmd.c
+Usage: ./bench_uring_cmd [-d device] [-n commands] [-c get|fill]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include "../../include/uapi/chardev_ioctl.h"
+#include "uring_min.h"
+
+#define DEFAULT_DEVICE "/dev/dynamic_ioctl_dev"
+
+static const unsigned int batches[] = { 1, 8, 32, 128, 256 };
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    const char *device = DEFAULT_DEVICE;
+    unsigned long n = 1000000;
+    unsigned int cmd = IOCTL_GET_SIZE;
+    unsigned long long uarg = 0;
+    struct io_uring_cqe cqe;
+    struct uring ring;
+    char fill = 'x';
+    int value, fd, opt;
+    double start, elapsed;
+
+    while ((opt = getopt(argc, argv, "d:n:c:")) != -1) {
+        switch (opt) {
+        case 'd': device = optarg; break;
+        case 'n': n = strtoul(optarg, NULL, 0); break;
+        case 'c':
+            if (!strcmp(optarg, "fill")) {
+                cmd = IOCTL_FILL_CHAR;
+                uarg = fill;
+            }
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-d device] [-n commands] [-c get|fill]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    fd = open(device, O_RDWR);
+    if (fd < 0) {
+        perror("open device");
+        return 1;
+    }
+    if (uring_init(&ring, batches[sizeof(batches) / sizeof(batches[0]) - 1]) < 0) {
+        perror("io_uring_setup");
+        return 1;
+    }
+
+    printf("%-10s %6s %12s %10s\n", "mode", "batch", "cmds/s", "ns/cmd");
+
+    start = now_sec();
+    for (unsigned long i = 0; i < n; i++) {
+        if (ioctl(fd, cmd, cmd == IOCTL_FILL_CHAR ? (void *)&fill : (void *)&value) < 0) {
+            perror("ioctl");
+            return 1;
+        }
+    }
+    elapsed = now_sec() - start;
+    printf("%-10s %6d %12.0f %10.1f\n", "ioctl", 1, n / elapsed, elapsed * 1e9 / n);
+
+    for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+        unsigned int batch = batches[b];
+        unsigned long done = 0, errors = 0;
+
+        start = now_sec();
+        while (done < n) {
+            unsigned int queued = 0;
+
+            while (queued < batch && done + queued < n && uring_prep_cmd(&ring, fd, cmd, uarg, 0) == 0)
+                queued++;
+            if (uring_submit_and_wait(&ring, queued) < 0) {
+                perror("io_uring_enter");
+                return 1;
+            }
+            while (uring_peek_cqe(&ring, &cqe) == 0) {
+                if (cqe.res < 0)
+                    errors++;
+                done++;
+            }
+        }
+        elapsed = now_sec() - start;
+        printf("%-10s %6u %12.0f %10.1f%s\n", "uring_cmd", batch, n / elapsed, elapsed * 1e9 / n,
+               errors ? "  (errors!)" : "");
+    }
+
+    close(ring.fd);
+    close(fd);
+    return 0;
+}
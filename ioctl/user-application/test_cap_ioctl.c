@@ -12,21 +12,10 @@ This app:
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <stdlib.h>
+#include "../../include/uapi/chardev_ioctl.h"
 
 #define DEVICE_PATH "/dev/cap_char_dev"
 
-#define IOCTL_BASE 'W'
-#define IOCTL_RETRIEVE      _IOR(IOCTL_BASE, 1, struct my_data *)
-#define IOCTL_FILL_UP       _IOW(IOCTL_BASE, 2, struct my_data *)
-#define IOCTL_SEND_TO_DEV   _IOW(IOCTL_BASE, 3, struct my_data *)
-#define IOCTL_REREAD_DEV    _IOR(IOCTL_BASE, 4, struct my_data *)
-
-struct my_data {
-    int i;
-    long x;
-    char s[100];
-};
-
 void print_data(const char *label, struct my_data *data) {
     printf("%s:\n", label);
     printf("  i = %d\n", data->i);
@@ -5,22 +5,15 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <errno.h>
+#include "../../include/uapi/chardev_ioctl.h"
 
 #define DEVICE "/dev/dynamic_ioctl_dev"
 
-// IOCTL command definitions
-#define MAGIC_NUM      0xF0
-#define IOCTL_FILL_ZERO    _IO(MAGIC_NUM, 1)
-#define IOCTL_FILL_CHAR    _IOW(MAGIC_NUM, 2, char)
-#define IOCTL_SET_SIZE     _IOW(MAGIC_NUM, 3, int)
-#define IOCTL_GET_SIZE     _IOR(MAGIC_NUM, 4, int)
-#define IOCTL_MAX_CMD      _IO(MAGIC_NUM, 5)
-
 int main() {
     int fd;
     char write_buf[] = "Hello Kernel!";
     char read_buf[50];
-    int new_size = 1000, current_size;
+    int new_size = 1000, current_size, max_cmds;
     char ch = '#';
 
     fd = open(DEVICE, O_RDWR);
@@ -56,9 +49,9 @@ int main() {
     ioctl(fd, IOCTL_GET_SIZE, &current_size);
     printf("IOCTL: Buffer size is %d\n", current_size);
 
-    // Max command test
-    ioctl(fd, IOCTL_MAX_CMD);
-    printf("IOCTL: Max command test done\n");
+    // Number of commands the driver supports
+    ioctl(fd, IOCTL_MAX_CMDS, &max_cmds);
+    printf("IOCTL: Driver supports %d commands\n", max_cmds);
 
     close(fd);
     return 0;
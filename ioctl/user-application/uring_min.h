@@ -0,0 +1,120 @@
+/* Minimal io_uring setup over the raw syscalls (no liburing needed)
+
+Just enough to queue IORING_OP_URING_CMD SQEs, submit them in one
+io_uring_enter() and reap the CQEs. Used by test_uring_cmd.c and
+bench_uring_cmd.c.
+*/
+#ifndef _URING_MIN_H
+#define _URING_MIN_H
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+struct uring {
+    int fd;
+    unsigned int entries;
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned int sq_local_tail;     // SQEs queued but not yet published
+};
+
+static inline int uring_init(struct uring *r, unsigned int entries) {
+    struct io_uring_params p;
+    size_t sq_len, cq_len;
+    char *sq, *cq;
+
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0)
+        return -1;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        fprintf(stderr, "kernel too old: no IORING_FEAT_SINGLE_MMAP\n");
+        return -1;
+    }
+
+    sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (cq_len > sq_len)
+        sq_len = cq_len;
+    sq = mmap(NULL, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED)
+        return -1;
+    cq = sq;    // single mmap covers both rings
+
+    r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED)
+        return -1;
+
+    r->entries = p.sq_entries;
+    r->sq_head = (unsigned int *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned int *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned int *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned int *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned int *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned int *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    r->sq_local_tail = *r->sq_tail;
+    return 0;
+}
+
+// Next free SQE, zeroed, or NULL when the ring is full
+static inline struct io_uring_sqe *uring_get_sqe(struct uring *r) {
+    unsigned int head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    struct io_uring_sqe *sqe;
+    unsigned int idx;
+
+    if (r->sq_local_tail - head >= r->entries)
+        return NULL;
+    idx = r->sq_local_tail & *r->sq_mask;
+    r->sq_array[idx] = idx;
+    r->sq_local_tail++;
+    sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// Queue one URING_CMD carrying an ioctl number and its inline 64-bit argument
+static inline int uring_prep_cmd(struct uring *r, int fd, unsigned int cmd_op,
+                                 unsigned long long arg, unsigned long long user_data) {
+    struct io_uring_sqe *sqe = uring_get_sqe(r);
+
+    if (!sqe)
+        return -1;
+    sqe->opcode = IORING_OP_URING_CMD;
+    sqe->fd = fd;
+    sqe->cmd_op = cmd_op;
+    sqe->user_data = user_data;
+    memcpy(sqe->cmd, &arg, sizeof(arg));
+    return 0;
+}
+
+// Publish queued SQEs and wait for at least @wait_nr completions
+static inline int uring_submit_and_wait(struct uring *r, unsigned int wait_nr) {
+    unsigned int to_submit = r->sq_local_tail - *r->sq_tail;
+
+    __atomic_store_n(r->sq_tail, r->sq_local_tail, __ATOMIC_RELEASE);
+    return syscall(__NR_io_uring_enter, r->fd, to_submit, wait_nr,
+                   wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+}
+
+// Pop one completion if available; returns 0 on success, -1 if the CQ is empty
+static inline int uring_peek_cqe(struct uring *r, struct io_uring_cqe *out) {
+    unsigned int head = *r->cq_head;
+
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE))
+        return -1;
+    *out = r->cqes[head & *r->cq_mask];
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+#endif /* _URING_MIN_H */
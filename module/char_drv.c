@@ -4,6 +4,10 @@
 #include <linux/cdev.h>
 #include <linux/uaccess.h>
 
+#define CREATE_TRACE_POINTS
+#define CHARDEV_TRACE_SYSTEM simple_char_dev
+#include "chardev_trace.h"
+
 #define DEVICE_NAME "simple_char_dev"
 #define BUF_SIZE 1024
 #define MAJOR_DEV 300
@@ -16,12 +20,14 @@ static char kernel_buffer[BUF_SIZE];
 
 static int dev_open(struct inode *inode, struct file *file)
 {
-    pr_info("Device opened\n");
+    trace_chardev_open(iminor(inode));
     return 0;
 }
 
 static ssize_t dev_read(struct file *file, char __user *user_buffer, size_t len, loff_t *offset)
 {
+    u64 start = chardev_trace_clock(trace_chardev_read_enabled());
+    loff_t pos = *offset;
     int bytes_read = 0;
 
     if (*offset >= BUF_SIZE)
@@ -36,13 +42,14 @@ static ssize_t dev_read(struct file *file, char __user *user_buffer, size_t len,
     *offset += len;
     bytes_read = len;
 
-    pr_info("Received read request from user space\n");
-    pr_info("Read %d bytes\n", bytes_read);
+    trace_chardev_read(pos, bytes_read, chardev_trace_since(start));
     return bytes_read;
 }
 
 static ssize_t dev_write(struct file *file, const char __user *user_buffer, size_t len, loff_t *offset)
 {
+    u64 start = chardev_trace_clock(trace_chardev_write_enabled());
+    loff_t pos = *offset;
     int bytes_written = 0;
 
     if (*offset >= BUF_SIZE)
@@ -57,14 +64,13 @@ static ssize_t dev_write(struct file *file, const char __user *user_buffer, size
     *offset += len;
     bytes_written = len;
 
-    pr_info("Received write request from user space\n");
-    pr_info("Wrote %d bytes\n", bytes_written);
+    trace_chardev_write(pos, bytes_written, chardev_trace_since(start));
     return bytes_written;
 }
 
 static int dev_release(struct inode *inode, struct file *file)
 {
-    pr_info("Device closed\n");
+    pr_debug("Device closed\n");
     return 0;
 }
 
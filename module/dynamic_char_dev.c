@@ -4,131 +4,532 @@
 #include <linux/cdev.h>
 #include <linux/device.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/topology.h>
+#include <linux/xarray.h>
+#include <linux/sizes.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+
+#define CREATE_TRACE_POINTS
+#define CHARDEV_TRACE_SYSTEM dynamic_char_dev
+#include "chardev_trace.h"
+#include "chardev_stats.h"
 
 #define DEVICE_NAME "dynamic_char_dev"
-#define BUF_SIZE 1024
+#define STORE_SIZE SZ_4G
+#define MAX_DEVICES 256
+
+/*
+ * Every minor is an independent instance with its own store, so workers
+ * pinned to different cores never share a buffer (or a cache line):
+ *     sudo insmod dynamic_char_dev.ko num_devices=8 buf_size=68719476736
+ *     -> /dev/dynamic_char_dev0 ... /dev/dynamic_char_dev7
+ *
+ * More instances can be added while the module is loaded:
+ *     echo 16 > /sys/module/dynamic_char_dev/parameters/num_devices
+ * The count cannot shrink at runtime: open files and mappings pin their
+ * instance's store, so removing minors needs an unload.
+ *
+ * With private_buffer=1 every open() gets its own store instead, hung off
+ * file->private_data and allocated on the NUMA node of the opening CPU.
+ */
+static unsigned int num_devices = 1;
+static DEFINE_MUTEX(instances_lock);        // num_devices and instances[]
+
+static int num_devices_set(const char *val, const struct kernel_param *kp);
+
+static const struct kernel_param_ops num_devices_ops = {
+    .set = num_devices_set,
+    .get = param_get_uint,
+};
+module_param_cb(num_devices, &num_devices_ops, &num_devices, 0644);
+MODULE_PARM_DESC(num_devices, "Number of minors (instances); can grow at runtime");
+
+static bool private_buffer;
+module_param(private_buffer, bool, S_IRUGO);
+MODULE_PARM_DESC(private_buffer, "Give every open file its own buffer");
+
+/*
+ * buf_size is only the virtual capacity of a store. Pages are allocated on
+ * first write (or first mmap fault) and never-written holes read as zeros,
+ * so memory use follows the data actually written, not the capacity.
+ */
+static unsigned long buf_size = STORE_SIZE;
+module_param(buf_size, ulong, S_IRUGO);
+MODULE_PARM_DESC(buf_size, "Virtual capacity in bytes per store (rounded up to PAGE_SIZE)");
+
+// Sparse page store: page index -> struct page *, populated lazily
+struct page_store {
+    struct xarray pages;
+    int node;                  // NUMA node new pages are allocated on
+};
 
-static dev_t dev_num;              // Allocated device number
-static struct cdev my_cdev;        // Character device structure
-static struct class *dev_class;    // Device class
-static struct device *dev_device;  // Device
+// Per-minor state, cacheline aligned so neighbouring instances never false-share
+struct char_dev_instance {
+    struct cdev cdev;          // Character device structure
+    struct page_store store;   // Instance store (unused with private_buffer)
+    unsigned int minor;
+} ____cacheline_aligned_in_smp;
 
-static char kernel_buffer[BUF_SIZE];
+static dev_t dev_num;                        // First allocated device number
+static struct class *dev_class;              // Device class
+static struct char_dev_instance **instances; // One pointer per minor
+static struct chardev_stats stats;           // Per-CPU op counters (debugfs)
+
+static void store_init(struct page_store *store, int node)
+{
+    xa_init(&store->pages);
+    store->node = node;
+}
+
+static void store_destroy(struct page_store *store)
+{
+    struct page *page;
+    unsigned long index;
+
+    xa_for_each(&store->pages, index, page)
+        __free_page(page);
+    xa_destroy(&store->pages);
+}
+
+// Return the page backing @index, allocating a zeroed one on first use
+static struct page *store_get_page(struct page_store *store, pgoff_t index, gfp_t gfp)
+{
+    struct page *page, *old;
+
+    page = xa_load(&store->pages, index);
+    if (page)
+        return page;
+
+    page = alloc_pages_node(store->node, gfp | __GFP_ZERO, 0);
+    if (!page)
+        return ERR_PTR(-ENOMEM);
+
+    // Another writer may have populated the slot meanwhile: keep theirs
+    old = xa_cmpxchg(&store->pages, index, NULL, page, gfp);
+    if (old) {
+        __free_page(page);
+        return xa_is_err(old) ? ERR_PTR(xa_err(old)) : old;
+    }
+    return page;
+}
 
 static int dev_open(struct inode *inode, struct file *file)
 {
-    pr_info("Device opened\n");
+    struct char_dev_instance *inst = container_of(inode->i_cdev, struct char_dev_instance, cdev);
+    struct page_store *store;
+
+    // file->private_data always points at the store this file works on
+    if (private_buffer) {
+        store = kmalloc_node(sizeof(*store), GFP_KERNEL, numa_node_id());
+        if (!store)
+            return -ENOMEM;
+        store_init(store, numa_node_id());
+        file->private_data = store;
+    } else {
+        file->private_data = &inst->store;
+    }
+
+    // read_iter/write_iter honour IOCB_NOWAIT, so io_uring may issue inline
+    file->f_mode |= FMODE_NOWAIT;
+
+    trace_chardev_open(inst->minor);
     return 0;
 }
 
-static ssize_t dev_read(struct file *file, char __user *user_buffer, size_t len, loff_t *offset)
+/*
+ * read_iter/write_iter serve read()/write(), readv()/writev(), pread/pwrite
+ * and io_uring alike: a whole iovec array is walked page by page in one call.
+ */
+static ssize_t store_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
-    int bytes_read = 0;
-    
-    if (*offset >= BUF_SIZE)
+    struct page_store *store = iocb->ki_filp->private_data;
+    size_t len = iov_iter_count(to);
+    size_t bytes_read = 0;
+
+    if (iocb->ki_pos >= buf_size)
         return 0;
 
-    if (len > BUF_SIZE - *offset)
-        len = BUF_SIZE - *offset;
+    if (len > buf_size - iocb->ki_pos)
+        len = buf_size - iocb->ki_pos;
 
-    if (copy_to_user(user_buffer, kernel_buffer + *offset, len))
-        return -EFAULT;
+    // Reads never allocate or sleep on a lock, so IOCB_NOWAIT needs no special case
+    while (bytes_read < len) {
+        loff_t pos = iocb->ki_pos + bytes_read;
+        size_t poff = offset_in_page(pos);
+        size_t chunk = min_t(size_t, PAGE_SIZE - poff, len - bytes_read);
+        struct page *page = xa_load(&store->pages, pos >> PAGE_SHIFT);
+        size_t copied;
 
-    *offset += len;
-    bytes_read = len;
+        // Holes were never written: they read as zeros
+        if (page)
+            copied = copy_page_to_iter(page, poff, chunk, to);
+        else
+            copied = iov_iter_zero(chunk, to);
+        bytes_read += copied;
+        if (copied < chunk)
+            break;
+    }
+
+    if (!bytes_read && len)
+        return -EFAULT;
 
-    pr_info("Received read request from user space\n");
-    pr_info("Read %d bytes\n", bytes_read);
+    iocb->ki_pos += bytes_read;
     return bytes_read;
 }
 
-static ssize_t dev_write(struct file *file, const char __user *user_buffer, size_t len, loff_t *offset)
+static ssize_t store_write_iter(struct kiocb *iocb, struct iov_iter *from)
 {
-    int bytes_written = 0;
-    
-    if (*offset >= BUF_SIZE)
+    struct page_store *store = iocb->ki_filp->private_data;
+    gfp_t gfp = (iocb->ki_flags & IOCB_NOWAIT) ? GFP_NOWAIT : GFP_KERNEL;
+    size_t len = iov_iter_count(from);
+    size_t bytes_written = 0;
+    ssize_t err = -EFAULT;
+
+    if (iocb->ki_pos >= buf_size)
         return -ENOMEM;
 
-    if (len > BUF_SIZE - *offset)
-        len = BUF_SIZE - *offset;
+    if (len > buf_size - iocb->ki_pos)
+        len = buf_size - iocb->ki_pos;
 
-    if (copy_from_user(kernel_buffer + *offset, user_buffer, len))
-        return -EFAULT;
+    while (bytes_written < len) {
+        loff_t pos = iocb->ki_pos + bytes_written;
+        size_t poff = offset_in_page(pos);
+        size_t chunk = min_t(size_t, PAGE_SIZE - poff, len - bytes_written);
+        struct page *page = store_get_page(store, pos >> PAGE_SHIFT, gfp);
+        size_t copied;
+
+        // A hole that cannot be filled without sleeping: let the caller retry blocking
+        if (IS_ERR(page)) {
+            err = (iocb->ki_flags & IOCB_NOWAIT) ? -EAGAIN : PTR_ERR(page);
+            break;
+        }
+
+        copied = copy_page_from_iter(page, poff, chunk, from);
+        bytes_written += copied;
+        if (copied < chunk)
+            break;
+    }
 
-    *offset += len;
-    bytes_written = len;
+    if (!bytes_written && len)
+        return err;
 
-    pr_info("Received write request from user space\n");
-    pr_info("Wrote %d bytes\n", bytes_written);
+    iocb->ki_pos += bytes_written;
     return bytes_written;
 }
 
+// Entry points: account every call in the per-CPU stats, then trace it
+static ssize_t dev_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    loff_t pos = iocb->ki_pos;
+    u64 start = ktime_get_ns();
+    ssize_t ret = store_read_iter(iocb, to);
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_READ, ret, start);
+
+    trace_chardev_read(pos, ret, ns);
+    return ret;
+}
+
+static ssize_t dev_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+    loff_t pos = iocb->ki_pos;
+    u64 start = ktime_get_ns();
+    ssize_t ret = store_write_iter(iocb, from);
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_WRITE, ret, start);
+
+    trace_chardev_write(pos, ret, ns);
+    return ret;
+}
+
+/*
+ * Pipe buffers handed out by splice_read reference the store pages themselves
+ * (no copy). They cannot be stolen, and a later write to the same offset is
+ * visible to a pipe reader that has not consumed the buffer yet, as with
+ * vmsplice().
+ */
+static const struct pipe_buf_operations store_pipe_buf_ops = {
+    .release = generic_pipe_buf_release,
+    .get = generic_pipe_buf_get,
+};
+
+static ssize_t dev_splice_read(struct file *file, loff_t *ppos, struct pipe_inode_info *pipe,
+                               size_t len, unsigned int flags)
+{
+    struct page_store *store = file->private_data;
+    ssize_t spliced = 0, ret = 0;
+
+    if (*ppos >= buf_size)
+        return 0;
+
+    if (len > buf_size - *ppos)
+        len = buf_size - *ppos;
+
+    while (spliced < len) {
+        loff_t pos = *ppos + spliced;
+        size_t poff = offset_in_page(pos);
+        struct pipe_buffer buf = {
+            .offset = poff,
+            .len = min_t(size_t, PAGE_SIZE - poff, len - spliced),
+            .ops = &store_pipe_buf_ops,
+        };
+
+        // Share populated pages; a hole gets a private zeroed page, the store stays sparse
+        buf.page = xa_load(&store->pages, pos >> PAGE_SHIFT);
+        if (buf.page)
+            get_page(buf.page);
+        else
+            buf.page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+        if (!buf.page) {
+            ret = -ENOMEM;
+            break;
+        }
+
+        // add_to_pipe() drops the page reference itself when the pipe is full
+        ret = add_to_pipe(pipe, &buf);
+        if (ret < 0)
+            break;
+        spliced += ret;
+    }
+
+    if (!spliced)
+        return ret;
+
+    *ppos += spliced;
+    return spliced;
+}
+
+// Seek anywhere inside the (64-bit) virtual capacity
+static loff_t dev_llseek(struct file *file, loff_t offset, int whence)
+{
+    return fixed_size_llseek(file, offset, whence, buf_size);
+}
+
 static int dev_release(struct inode *inode, struct file *file)
 {
-    pr_info("Device closed\n");
+    // The vma pins the file, so a mapped private store outlives munmap() only
+    if (private_buffer) {
+        store_destroy(file->private_data);
+        kfree(file->private_data);
+    }
+
+    pr_debug("Device closed\n");
+    return 0;
+}
+
+// Populate the mapping one page at a time, allocating holes on first touch
+static vm_fault_t dev_vm_fault(struct vm_fault *vmf)
+{
+    struct page_store *store = vmf->vma->vm_private_data;
+    struct page *page;
+
+    if (vmf->pgoff >= buf_size >> PAGE_SHIFT)
+        return VM_FAULT_SIGBUS;
+
+    page = store_get_page(store, vmf->pgoff, GFP_KERNEL);
+    if (IS_ERR(page))
+        return VM_FAULT_OOM;
+
+    get_page(page);
+    vmf->page = page;
+    return 0;
+}
+
+static const struct vm_operations_struct dev_vm_ops = {
+    .fault = dev_vm_fault,
+};
+
+// Map the device store into the caller: no copy and no syscall per access
+static int dev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    unsigned long len = vma->vm_end - vma->vm_start;
+    unsigned long off = vma->vm_pgoff << PAGE_SHIFT;
+
+    if (off >= buf_size || len > buf_size - off)
+        return -EINVAL;
+
+    vm_flags_set(vma, VM_DONTEXPAND | VM_DONTDUMP);
+    vma->vm_private_data = file->private_data;
+    vma->vm_ops = &dev_vm_ops;
     return 0;
 }
 
 static struct file_operations fops = {
     .owner = THIS_MODULE,
     .open = dev_open,
-    .read = dev_read,
-    .write = dev_write,
+    .read_iter = dev_read_iter,
+    .write_iter = dev_write_iter,
+    .splice_read = dev_splice_read,
+    .splice_write = iter_file_splice_write,
+    .llseek = dev_llseek,
+    .mmap = dev_mmap,
     .release = dev_release,
 };
 
-static int __init char_init(void)
+static void destroy_instance(struct char_dev_instance *inst)
 {
+    cdev_del(&inst->cdev);
+    device_destroy(dev_class, MKDEV(MAJOR(dev_num), inst->minor));
+    store_destroy(&inst->store);
+    kfree(inst);
+}
+
+static int create_instance(unsigned int minor)
+{
+    struct char_dev_instance *inst;
+    struct device *dev_device;
+    int node = numa_node_id();
     int ret;
 
-    // Allocate device number
-    ret = alloc_chrdev_region(&dev_num, 0, 1, DEVICE_NAME);
-    if (ret < 0) {
-        pr_err("Failed to allocate device number\n");
-        return ret;
-    }
+    // Instance state and store pages both live on the creating CPU's node
+    inst = kzalloc_node(sizeof(*inst), GFP_KERNEL, node);
+    if (!inst)
+        return -ENOMEM;
 
-    // Create device class
-    dev_class = class_create(DEVICE_NAME);
-    if (IS_ERR(dev_class)) {
-        unregister_chrdev_region(dev_num, 1);
-        pr_err("Failed to create class\n");
-        return PTR_ERR(dev_class);
-    }
+    inst->minor = minor;
+    store_init(&inst->store, node);
 
     // Create device
-    dev_device = device_create(dev_class, NULL, dev_num, NULL, DEVICE_NAME);
+    dev_device = device_create(dev_class, NULL, MKDEV(MAJOR(dev_num), minor), NULL,
+                               DEVICE_NAME "%u", minor);
     if (IS_ERR(dev_device)) {
-        class_destroy(dev_class);
-        unregister_chrdev_region(dev_num, 1);
-        pr_err("Failed to create device\n");
+        kfree(inst);
         return PTR_ERR(dev_device);
     }
 
     // Initialize the cdev structure and link it with file operations
-    cdev_init(&my_cdev, &fops);
-    my_cdev.owner = THIS_MODULE;
+    cdev_init(&inst->cdev, &fops);
+    inst->cdev.owner = THIS_MODULE;
 
     // Attach char device with device node and allow the file operations
-    ret = cdev_add(&my_cdev, dev_num, 1);
+    ret = cdev_add(&inst->cdev, MKDEV(MAJOR(dev_num), minor), 1);
     if (ret < 0) {
-        device_destroy(dev_class, dev_num);
-        class_destroy(dev_class);
-        unregister_chrdev_region(dev_num, 1);
-        pr_err("Failed to add char device\n");
+        device_destroy(dev_class, MKDEV(MAJOR(dev_num), minor));
+        kfree(inst);
         return ret;
     }
 
-    pr_info("Dynamic char device registered: Major %d, Minor %d\n", MAJOR(dev_num), MINOR(dev_num));
+    instances[minor] = inst;
     return 0;
 }
 
+static int num_devices_set(const char *val, const struct kernel_param *kp)
+{
+    unsigned int n, i;
+    int ret = kstrtouint(val, 0, &n);
+
+    if (ret)
+        return ret;
+    if (!n || n > MAX_DEVICES)
+        return -EINVAL;
+
+    mutex_lock(&instances_lock);
+    if (!dev_class) {
+        // Load time (or unloading): char_init() creates the instances
+        num_devices = n;
+    } else if (n < num_devices) {
+        ret = -EBUSY;
+    } else {
+        for (i = num_devices; i < n; i++) {
+            ret = create_instance(i);
+            if (ret < 0)
+                break;
+        }
+        num_devices = i;
+        pr_info("Dynamic char device now has %u minors\n", num_devices);
+    }
+    mutex_unlock(&instances_lock);
+    return ret;
+}
+
+static int __init char_init(void)
+{
+    unsigned int i;
+    int ret;
+
+    buf_size = PAGE_ALIGN(buf_size);
+    if (!buf_size || buf_size > MAX_LFS_FILESIZE || !num_devices || num_devices > MAX_DEVICES)
+        return -EINVAL;
+
+    ret = chardev_stats_init(&stats, DEVICE_NAME);
+    if (ret)
+        return ret;
+
+    // Size for MAX_DEVICES up front so num_devices can grow without moving anything
+    instances = kcalloc(MAX_DEVICES, sizeof(*instances), GFP_KERNEL);
+    if (!instances) {
+        chardev_stats_exit(&stats);
+        return -ENOMEM;
+    }
+
+    // Reserve device numbers for every instance num_devices may grow to
+    ret = alloc_chrdev_region(&dev_num, 0, MAX_DEVICES, DEVICE_NAME);
+    if (ret < 0) {
+        pr_err("Failed to allocate device numbers\n");
+        kfree(instances);
+        chardev_stats_exit(&stats);
+        return ret;
+    }
+
+    // A num_devices write only sees dev_class once the initial instances exist
+    mutex_lock(&instances_lock);
+
+    // Create device class
+    dev_class = class_create(DEVICE_NAME);
+    if (IS_ERR(dev_class)) {
+        ret = PTR_ERR(dev_class);
+        dev_class = NULL;
+        mutex_unlock(&instances_lock);
+        unregister_chrdev_region(dev_num, MAX_DEVICES);
+        kfree(instances);
+        chardev_stats_exit(&stats);
+        pr_err("Failed to create class\n");
+        return ret;
+    }
+
+    for (i = 0; i < num_devices; i++) {
+        ret = create_instance(i);
+        if (ret < 0) {
+            pr_err("Failed to create instance %u\n", i);
+            goto r_instances;
+        }
+    }
+    mutex_unlock(&instances_lock);
+
+    pr_info("Dynamic char device registered: Major %d, %u minors, capacity %lu bytes%s\n",
+            MAJOR(dev_num), num_devices, buf_size, private_buffer ? " per open file" : "");
+    return 0;
+
+r_instances:
+    while (i--)
+        destroy_instance(instances[i]);
+    class_destroy(dev_class);
+    dev_class = NULL;
+    mutex_unlock(&instances_lock);
+    unregister_chrdev_region(dev_num, MAX_DEVICES);
+    kfree(instances);
+    chardev_stats_exit(&stats);
+    return ret;
+}
+
 static void __exit char_exit(void)
 {
-    cdev_del(&my_cdev);
-    device_destroy(dev_class, dev_num);
+    unsigned int i;
+
+    // The parameter file outlives exit(): a late write must find no class to grow
+    mutex_lock(&instances_lock);
+    for (i = 0; i < num_devices; i++)
+        destroy_instance(instances[i]);
     class_destroy(dev_class);
-    unregister_chrdev_region(dev_num, 1);
+    dev_class = NULL;
+    mutex_unlock(&instances_lock);
+    unregister_chrdev_region(dev_num, MAX_DEVICES);
+    kfree(instances);
+    chardev_stats_exit(&stats);
     pr_info("Dynamic char device unregistered\n");
 }
 
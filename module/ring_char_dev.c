@@ -0,0 +1,298 @@
+/* Record ring char device with an exported in-kernel producer API
+
+Like mod.c exports func() for depmod.c, this module exports
+chardev_ring_reserve()/chardev_ring_commit() (include/chardev_ring.h) so other
+modules can feed /dev/ring_char_dev directly. ring_producer.c is the
+example consumer of the API.
+
+The ring is @slots fixed-size slots. Three free-running counters track it:
+    head   - next slot to reserve        (producers)
+    commit - slots before it are readable (producers, in order)
+    tail   - next slot to read            (reader)
+Producers hold ring.lock only to move head/commit, never while copying data,
+so filling a record in place runs in parallel on every CPU.
+
+    sudo insmod ring_char_dev.ko slots=4096 slot_size=256
+    cat /dev/ring_char_dev
+*/
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/uio.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/slab.h>
+#include <linux/log2.h>
+#include <linux/sizes.h>
+
+#define CREATE_TRACE_POINTS
+#define CHARDEV_TRACE_SYSTEM ring_char_dev
+#include "chardev_trace.h"
+#include "chardev_stats.h"
+#include "chardev_ring.h"
+
+#define DEVICE_NAME "ring_char_dev"
+
+static unsigned int slots = 1024;
+module_param(slots, uint, S_IRUGO);
+MODULE_PARM_DESC(slots, "Number of record slots (rounded up to a power of two)");
+
+static unsigned int slot_size = PAGE_SIZE;
+module_param(slot_size, uint, S_IRUGO);
+MODULE_PARM_DESC(slot_size, "Maximum record size in bytes");
+
+struct ring_slot {
+    u32 len;            // committed record length
+    bool committed;
+};
+
+static struct {
+    spinlock_t lock;            // head, commit, tail and slot state
+    u32 head;
+    u32 commit;
+    u32 tail;
+    u32 mask;
+    char *data;                 // slots * slot_size bytes
+    struct ring_slot *meta;
+    wait_queue_head_t readq;    // readers waiting for committed records
+    struct mutex read_lock;     // one reader consumes at a time
+    size_t read_off;            // bytes of slot @tail already read
+} ring;
+
+static dev_t dev_num;
+static struct class *dev_class;
+static struct cdev ring_cdev;
+static struct chardev_stats stats;
+
+static inline char *slot_data(u32 seq)
+{
+    return ring.data + (size_t)(seq & ring.mask) * slot_size;
+}
+
+int chardev_ring_reserve(struct chardev_ring_resv *resv, size_t len)
+{
+    unsigned long flags;
+    u32 seq;
+
+    if (!len || len > slot_size)
+        return -EMSGSIZE;
+
+    spin_lock_irqsave(&ring.lock, flags);
+    if (ring.head - ring.tail > ring.mask) {
+        spin_unlock_irqrestore(&ring.lock, flags);
+        return -ENOSPC;
+    }
+    seq = ring.head++;
+    ring.meta[seq & ring.mask].committed = false;
+    spin_unlock_irqrestore(&ring.lock, flags);
+
+    resv->data = slot_data(seq);
+    resv->size = slot_size;
+    resv->seq = seq;
+    return 0;
+}
+EXPORT_SYMBOL(chardev_ring_reserve);
+
+void chardev_ring_commit(struct chardev_ring_resv *resv, size_t used)
+{
+    struct ring_slot *slot = &ring.meta[resv->seq & ring.mask];
+    unsigned long flags;
+    u32 commit;
+
+    spin_lock_irqsave(&ring.lock, flags);
+    slot->len = min_t(size_t, used, slot_size);
+    slot->committed = true;
+
+    // Publish the run of committed slots; an older reservation still being filled holds it back
+    commit = ring.commit;
+    while (commit != ring.head && ring.meta[commit & ring.mask].committed)
+        commit++;
+    // Pairs with smp_load_acquire() in the reader: record bytes are visible before the index
+    smp_store_release(&ring.commit, commit);
+    spin_unlock_irqrestore(&ring.lock, flags);
+
+    if (wq_has_sleeper(&ring.readq))
+        wake_up_interruptible(&ring.readq);
+}
+EXPORT_SYMBOL(chardev_ring_commit);
+
+size_t chardev_ring_max_record(void)
+{
+    return slot_size;
+}
+EXPORT_SYMBOL(chardev_ring_max_record);
+
+static inline bool ring_readable(void)
+{
+    return ring.tail != smp_load_acquire(&ring.commit);
+}
+
+static int dev_open(struct inode *inode, struct file *file)
+{
+    trace_chardev_open(iminor(inode));
+    return 0;
+}
+
+static int dev_release(struct inode *inode, struct file *file)
+{
+    pr_debug("Device closed\n");
+    return 0;
+}
+
+// Records are returned as one byte stream; a short read resumes mid-record
+static ssize_t do_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    bool nonblock = (iocb->ki_flags & IOCB_NOWAIT) || (iocb->ki_filp->f_flags & O_NONBLOCK);
+    ssize_t copied = 0;
+    unsigned long flags;
+    int ret;
+
+    if (mutex_lock_interruptible(&ring.read_lock))
+        return -ERESTARTSYS;
+
+    while (!ring_readable()) {
+        mutex_unlock(&ring.read_lock);
+        if (nonblock)
+            return -EAGAIN;
+        ret = wait_event_interruptible(ring.readq, ring_readable());
+        if (ret)
+            return ret;
+        if (mutex_lock_interruptible(&ring.read_lock))
+            return -ERESTARTSYS;
+    }
+
+    // Only this reader moves tail, so slots in [tail, commit) are stable without ring.lock
+    while (iov_iter_count(to) && ring_readable()) {
+        struct ring_slot *slot = &ring.meta[ring.tail & ring.mask];
+        size_t n = min_t(size_t, slot->len - ring.read_off, iov_iter_count(to));
+
+        if (n && copy_to_iter(slot_data(ring.tail) + ring.read_off, n, to) != n) {
+            if (!copied)
+                copied = -EFAULT;
+            break;
+        }
+        copied += n;
+        ring.read_off += n;
+
+        if (ring.read_off == slot->len) {
+            ring.read_off = 0;
+            spin_lock_irqsave(&ring.lock, flags);
+            ring.tail++;
+            spin_unlock_irqrestore(&ring.lock, flags);
+        }
+    }
+
+    mutex_unlock(&ring.read_lock);
+    return copied;
+}
+
+static ssize_t dev_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+    u64 start = ktime_get_ns();
+    ssize_t ret = do_read_iter(iocb, to);
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_READ, ret, start);
+
+    trace_chardev_read(iocb->ki_pos, ret, ns);
+    return ret;
+}
+
+static __poll_t dev_poll(struct file *file, poll_table *wait)
+{
+    poll_wait(file, &ring.readq, wait);
+    return ring_readable() ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+static const struct file_operations fops = {
+    .owner = THIS_MODULE,
+    .open = dev_open,
+    .release = dev_release,
+    .read_iter = dev_read_iter,
+    .poll = dev_poll,
+    .llseek = noop_llseek,
+};
+
+static int __init ring_init(void)
+{
+    int ret;
+
+    if (!slots || !slot_size || slot_size > SZ_1M)
+        return -EINVAL;
+    slots = roundup_pow_of_two(slots);
+
+    spin_lock_init(&ring.lock);
+    mutex_init(&ring.read_lock);
+    init_waitqueue_head(&ring.readq);
+    ring.mask = slots - 1;
+    ring.data = vmalloc(array_size(slots, slot_size));
+    ring.meta = kvcalloc(slots, sizeof(*ring.meta), GFP_KERNEL);
+    if (!ring.data || !ring.meta) {
+        ret = -ENOMEM;
+        goto r_ring;
+    }
+
+    ret = chardev_stats_init(&stats, DEVICE_NAME);
+    if (ret)
+        goto r_ring;
+
+    ret = alloc_chrdev_region(&dev_num, 0, 1, DEVICE_NAME);
+    if (ret < 0)
+        goto r_stats;
+
+    cdev_init(&ring_cdev, &fops);
+    ret = cdev_add(&ring_cdev, dev_num, 1);
+    if (ret < 0)
+        goto r_region;
+
+    dev_class = class_create(DEVICE_NAME);
+    if (IS_ERR(dev_class)) {
+        ret = PTR_ERR(dev_class);
+        goto r_cdev;
+    }
+
+    if (IS_ERR(device_create(dev_class, NULL, dev_num, NULL, DEVICE_NAME))) {
+        ret = -ENODEV;
+        goto r_class;
+    }
+
+    pr_info("Ring char device loaded: %u slots x %u bytes, Major=%d\n",
+            slots, slot_size, MAJOR(dev_num));
+    return 0;
+
+r_class:
+    class_destroy(dev_class);
+r_cdev:
+    cdev_del(&ring_cdev);
+r_region:
+    unregister_chrdev_region(dev_num, 1);
+r_stats:
+    chardev_stats_exit(&stats);
+r_ring:
+    kvfree(ring.meta);
+    vfree(ring.data);
+    return ret;
+}
+
+static void __exit ring_exit(void)
+{
+    // Module refcounting keeps us loaded while a producer module is using the symbols
+    device_destroy(dev_class, dev_num);
+    class_destroy(dev_class);
+    cdev_del(&ring_cdev);
+    unregister_chrdev_region(dev_num, 1);
+    chardev_stats_exit(&stats);
+    kvfree(ring.meta);
+    vfree(ring.data);
+    pr_info("Ring char device unloaded\n");
+}
+
+module_init(ring_init);
+module_exit(ring_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Purushotham");
+MODULE_DESCRIPTION("Record ring char device with exported reserve/commit producer API");
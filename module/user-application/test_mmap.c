@@ -0,0 +1,53 @@
+/* Maps /dev/dynamic_char_dev0 into the process and exchanges data with read()/write().
+
+    1. write() a message through the syscall path and check it is visible in the mapping.
+    2. Update the mapping directly and read() it back through the syscall path.
+
+Build: gcc -o test_mmap test_mmap.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define DEVICE_PATH "/dev/dynamic_char_dev0"
+#define MAP_LEN     4096
+
+int main(int argc, char *argv[]) {
+    const char *msg = "Hello through write()";
+    const char *update = "Hello through mmap()";
+    size_t len = argc > 1 ? strtoul(argv[1], NULL, 0) : MAP_LEN;
+    char buf[64] = {0};
+    char *map;
+    int fd;
+
+    fd = open(DEVICE_PATH, O_RDWR);
+    if (fd < 0) {
+        perror("open");
+        return 1;
+    }
+
+    map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        close(fd);
+        return 1;
+    }
+
+    // Syscall write -> visible in the mapping
+    if (pwrite(fd, msg, strlen(msg) + 1, 0) < 0)
+        perror("pwrite");
+    printf("Mapping sees: %s\n", map);
+
+    // Store into the mapping -> visible to read()
+    strcpy(map, update);
+    if (pread(fd, buf, sizeof(buf) - 1, 0) < 0)
+        perror("pread");
+    printf("read() sees : %s\n", buf);
+
+    munmap(map, len);
+    close(fd);
+    return 0;
+}
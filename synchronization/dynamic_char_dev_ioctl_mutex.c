@@ -20,6 +20,60 @@ Driver Features
         Check lock status
         Unlock
     Includes read/write with mutex protection
+    Selectable read path (IOCTL_SET_READ_MODE): mutex, seqcount or RCU
+    Lockless SPSC/MPMC ring mode (IOCTL_SET_RING_MODE)
+    my_mutex as an rt_mutex with priority inheritance (load with pi=1)
+    Wait/hold times and top contenders of my_mutex in
+        /sys/kernel/debug/mutex_demo/locks/my_mutex (see chardev_lockstat.h)
+
+Read Modes
+
+The buffer is read-mostly, and with the mutex every reader waits for every
+other reader. Writers always serialise on my_mutex, and each write updates
+shared_buffer inside a seqcount write section and publishes a fresh RCU copy
+of it, so any read mode can be selected at any time:
+
+    MUTEX_READ_MUTEX     mutex_lock(), copy_to_user(), mutex_unlock()
+    MUTEX_READ_SEQCOUNT  copy shared_buffer to the stack until no writer ran
+                         meanwhile, then copy_to_user() without any lock
+    MUTEX_READ_RCU       copy the published buffer to the stack under
+                         rcu_read_lock(), then copy_to_user()
+
+Both lockless modes stage the data on the stack because copy_to_user() may
+fault and sleep, which neither a seqcount retry loop nor an RCU read-side
+section allows. Readers in those modes also ignore a mutex held through
+IOCTL_LOCK.
+
+Ring Mode
+
+IOCTL_SET_RING_MODE replaces shared_buffer with a lockless ring for
+streaming: writes append, reads drain, and a full or empty ring blocks (or
+returns -EAGAIN with O_NONBLOCK). RING_MODE_SPSC is a kfifo for one writer
+and one reader, RING_MODE_MPMC a message ring for any number of each; see
+chardev_lfring.h. my_mutex is not taken in either, and read modes do not
+apply.
+
+Priority Inheritance
+
+A plain mutex lets a low-priority owner (say, one that took it with
+IOCTL_LOCK and was then preempted by a busy medium-priority task) delay a
+SCHED_FIFO reader without bound. Loaded with pi=1, my_mutex is an rt_mutex
+instead: a waiter lends its priority to the owner until the owner unlocks,
+so the wait is bounded by the owner's critical section. The choice is made
+at load time because the two lock types cannot be swapped under holders;
+every variant maps over (rt_mutex_lock(), _interruptible(), _killable(),
+rt_mutex_trylock()). /sys/module/<module>/parameters/pi shows the mode;
+bench_mutex_pi compares the two.
+
+Only the task that took my_mutex with an IOCTL_LOCK* command may release it:
+IOCTL_UNLOCK from any other task fails with -EPERM (a mutex, and even more
+an rt_mutex with its priority chain, must be unlocked by its owner). Closing
+the file drops a lock it still holds. The owner's task_struct stays pinned
+while it holds the lock, so an owner that dies without closing the file
+(a thread whose process lives on) leaks the lock but never leaves it
+pointing at freed memory.
+
+    sudo insmod dynamic_char_dev_ioctl_mutex.ko pi=1
 
 Summary of Test Results
 Lock Type	                        Signal Sent	        Interrupted?	        Comment
@@ -35,100 +89,324 @@ mutex_lock_killable()	            SIGINT	            ❌ No	               Conti
 #include <linux/uaccess.h>
 #include <linux/device.h>
 #include <linux/mutex.h>
+#include <linux/rtmutex.h>
 #include <linux/ioctl.h>
 #include <linux/delay.h>
+#include <linux/seqlock.h>
+#include <linux/rcupdate.h>
+#include <linux/slab.h>
+
+#define CREATE_TRACE_POINTS
+#define CHARDEV_TRACE_SYSTEM mutex_demo
+#include "chardev_trace.h"
+#include "chardev_stats.h"
+#include "chardev_lockstat.h"
+#include "chardev_lfring.h"
+#include "uapi/chardev_ioctl.h"
 
 #define DEVICE_NAME "mutex_demo"
 #define CLASS_NAME  "mutexcls"
 
-#define IOCTL_LOCK              _IO('M', 1)
-#define IOCTL_LOCK_INTERRUPTIBLE _IO('M', 2)
-#define IOCTL_LOCK_KILLABLE     _IO('M', 3)
-#define IOCTL_TRYLOCK           _IO('M', 4)
-#define IOCTL_IS_LOCKED         _IOR('M', 5, int)
-#define IOCTL_UNLOCK            _IO('M', 6)
-
 static int major;
 static struct class *cls;
 static struct cdev my_cdev;
 
+static bool pi;
+module_param(pi, bool, S_IRUGO);
+MODULE_PARM_DESC(pi, "Make my_mutex an rt_mutex with priority inheritance");
+
+// my_mutex is whichever of the two pi selects; only use the my_mutex_*() helpers
 static DEFINE_MUTEX(my_mutex);
+static DEFINE_RT_MUTEX(my_rt_mutex);
 static char shared_buffer[100] = "Init";
+static struct chardev_stats stats;
+static struct chardev_lockstat my_mutex_stat;
+static u64 my_mutex_since;     // when the current owner took my_mutex
+
+// Who holds my_mutex through IOCTL_LOCK*; only written by that holder
+static struct task_struct *ioctl_owner;
+static struct file *ioctl_owner_file;
+
+/*
+ * Bumped around every update of shared_buffer; writers hold my_mutex. A
+ * plain seqcount_t since there is no seqcount type for rt_mutex: writers
+ * disable preemption themselves so lockless readers never spin on a
+ * preempted writer.
+ */
+static seqcount_t buffer_seq = SEQCNT_ZERO(buffer_seq);
+
+struct buffer_copy {
+    struct rcu_head rcu;
+    char data[sizeof(shared_buffer)];
+};
+
+// Latest contents of shared_buffer for MUTEX_READ_RCU readers
+static struct buffer_copy __rcu *published;
+static int read_mode = MUTEX_READ_MUTEX;
+
+static struct chardev_lfring ring;
+static int ring_mode = RING_MODE_OFF;
 
 static int dev_open(struct inode *inode, struct file *file) {
-    pr_info("Device opened\n");
+    trace_chardev_open(iminor(inode));
     return 0;
 }
 
+static bool my_mutex_trylock(void) {
+    return pi ? rt_mutex_trylock(&my_rt_mutex) : mutex_trylock(&my_mutex);
+}
+
+static void my_mutex_lock(void) {
+    if (pi)
+        rt_mutex_lock(&my_rt_mutex);
+    else
+        mutex_lock(&my_mutex);
+}
+
+static int my_mutex_lock_interruptible(void) {
+    return pi ? rt_mutex_lock_interruptible(&my_rt_mutex) : mutex_lock_interruptible(&my_mutex);
+}
+
+static int my_mutex_lock_killable(void) {
+    return pi ? rt_mutex_lock_killable(&my_rt_mutex) : mutex_lock_killable(&my_mutex);
+}
+
+static bool my_mutex_is_locked(void) {
+    return pi ? rt_mutex_base_is_locked(&my_rt_mutex.rtmutex) : mutex_is_locked(&my_mutex);
+}
+
+static bool my_mutex_held(void) {
+    return pi ? lockdep_is_held(&my_rt_mutex) : lockdep_is_held(&my_mutex);
+}
+
+// Takes my_mutex and reports how long the caller waited for it; inlined so
+// every caller shows up as its own site in locks/my_mutex
+static __always_inline void traced_mutex_lock(const char *variant) {
+    u64 start = chardev_trace_clock(trace_chardev_lock_enabled());
+    chardev_lockstat_lock(&my_mutex_stat, my_mutex_since, my_mutex_trylock(), my_mutex_lock());
+    trace_chardev_lock("my_mutex", variant, 0, chardev_trace_since(start));
+}
+
+static void my_mutex_unlock(void) {
+    if (pi)
+        chardev_lockstat_unlock(&my_mutex_stat, my_mutex_since, rt_mutex_unlock(&my_rt_mutex));
+    else
+        chardev_lockstat_unlock(&my_mutex_stat, my_mutex_since, mutex_unlock(&my_mutex));
+}
+
+// Called with my_mutex just taken by an IOCTL_LOCK* command on @file
+static void ioctl_lock_taken(struct file *file) {
+    WRITE_ONCE(ioctl_owner, get_task_struct(current));
+    WRITE_ONCE(ioctl_owner_file, file);
+}
+
+// Called by ioctl_owner only
+static void ioctl_unlock(void) {
+    struct task_struct *owner = ioctl_owner;
+
+    WRITE_ONCE(ioctl_owner, NULL);
+    WRITE_ONCE(ioctl_owner_file, NULL);
+    my_mutex_unlock();
+    put_task_struct(owner);
+}
+
 static int dev_release(struct inode *inode, struct file *file) {
-    pr_info("Device released\n");
+    // Nobody else can use @file any more, so ioctl_owner_file cannot become @file meanwhile
+    if (READ_ONCE(ioctl_owner_file) == file) {
+        if (ioctl_owner == current) {
+            ioctl_unlock();
+        } else {
+            pr_warn("my_mutex stays held: its owner %d did not close this file\n",
+                    task_pid_nr(ioctl_owner));
+            WRITE_ONCE(ioctl_owner_file, NULL);
+        }
+    }
+    pr_debug("Device released\n");
     return 0;
 }
 
+static ssize_t do_dev_read(struct file *file, char __user *buf, size_t len, loff_t *off) {
+    int mode = READ_ONCE(ring_mode);
+    char snap[sizeof(shared_buffer)];
+    struct buffer_copy *copy;
+    unsigned int seq;
+    ssize_t ret;
+
+    if (mode != RING_MODE_OFF)
+        return chardev_lfring_read(&ring, mode, buf, len, file->f_flags & O_NONBLOCK);
+
+    switch (READ_ONCE(read_mode)) {
+    case MUTEX_READ_SEQCOUNT:
+        do {
+            seq = read_seqcount_begin(&buffer_seq);
+            memcpy(snap, shared_buffer, sizeof(snap));
+        } while (read_seqcount_retry(&buffer_seq, seq));
+        break;
+
+    case MUTEX_READ_RCU:
+        rcu_read_lock();
+        copy = rcu_dereference(published);
+        memcpy(snap, copy->data, sizeof(snap));
+        rcu_read_unlock();
+        break;
+
+    default:
+        traced_mutex_lock("read");
+        ret = simple_read_from_buffer(buf, len, off, shared_buffer, sizeof(shared_buffer));
+        my_mutex_unlock();
+        return ret;
+    }
+    return simple_read_from_buffer(buf, len, off, snap, sizeof(snap));
+}
+
 static ssize_t dev_read(struct file *file, char __user *buf, size_t len, loff_t *off) {
-    mutex_lock(&my_mutex);
-    pr_info("Reading protected data\n");
-    ssize_t ret = simple_read_from_buffer(buf, len, off, shared_buffer, sizeof(shared_buffer));
-    mutex_unlock(&my_mutex);
+    u64 start = ktime_get_ns();
+    loff_t pos = *off;
+    ssize_t ret = do_dev_read(file, buf, len, off);
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_READ, ret, start);
+
+    trace_chardev_read(pos, ret, ns);
+    return ret;
+}
+
+/*
+ * The new contents are built in a scratch copy first: the seqcount write
+ * section must not fault on user memory while lockless readers spin on it.
+ */
+static ssize_t do_dev_write(struct file *file, const char __user *buf, size_t len, loff_t *off) {
+    int mode = READ_ONCE(ring_mode);
+    char tmp[sizeof(shared_buffer)];
+    struct buffer_copy *copy, *old;
+    ssize_t ret;
+
+    if (mode != RING_MODE_OFF)
+        return chardev_lfring_write(&ring, mode, buf, len, file->f_flags & O_NONBLOCK);
+
+    copy = kmalloc(sizeof(*copy), GFP_KERNEL);
+    if (!copy)
+        return -ENOMEM;
+
+    traced_mutex_lock("write");
+    memcpy(tmp, shared_buffer, sizeof(tmp));
+    ret = simple_write_to_buffer(tmp, sizeof(tmp), off, buf, len);
+    if (ret < 0) {
+        my_mutex_unlock();
+        kfree(copy);
+        return ret;
+    }
+    tmp[min_t(loff_t, *off, sizeof(tmp) - 1)] = '\0';
+
+    preempt_disable();
+    lockdep_assert(my_mutex_held());
+    write_seqcount_begin(&buffer_seq);
+    memcpy(shared_buffer, tmp, sizeof(tmp));
+    write_seqcount_end(&buffer_seq);
+    preempt_enable();
+
+    memcpy(copy->data, tmp, sizeof(tmp));
+    old = rcu_replace_pointer(published, copy, my_mutex_held());
+    my_mutex_unlock();
+
+    kfree_rcu(old, rcu);
     return ret;
 }
 
 static ssize_t dev_write(struct file *file, const char __user *buf, size_t len, loff_t *off) {
-    mutex_lock(&my_mutex);
-    pr_info("Writing protected data\n");
-    ssize_t ret = simple_write_to_buffer(shared_buffer, sizeof(shared_buffer), off, buf, len);
-    shared_buffer[ret] = '\0';
-    mutex_unlock(&my_mutex);
+    u64 start = ktime_get_ns();
+    loff_t pos = *off;
+    ssize_t ret = do_dev_write(file, buf, len, off);
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_WRITE, ret, start);
+
+    trace_chardev_write(pos, ret, ns);
     return ret;
 }
 
-static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+static long do_dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
     int status = 0;
+    u64 start;
+    int ret;
+
+    // my_mutex is not recursive: a second IOCTL_LOCK* by its owner would deadlock
+    if ((cmd == IOCTL_LOCK || cmd == IOCTL_LOCK_INTERRUPTIBLE || cmd == IOCTL_LOCK_KILLABLE ||
+         cmd == IOCTL_TRYLOCK) && READ_ONCE(ioctl_owner) == current)
+        return -EDEADLK;
 
     switch (cmd) {
     case IOCTL_LOCK:
-        pr_info("[IOCTL] mutex_lock()\n");
-        mutex_lock(&my_mutex);
+        pr_debug("[IOCTL] mutex_lock()\n");
+        traced_mutex_lock("lock");
+        ioctl_lock_taken(file);
         break;
 
         case IOCTL_LOCK_INTERRUPTIBLE:
-        pr_info("Trying mutex_lock_interruptible (5s sleep)...\n");
+        pr_debug("Trying mutex_lock_interruptible (5s sleep)...\n");
         msleep(5000);  // Give time to interrupt
-        int ret = mutex_lock_interruptible(&my_mutex);
+        start = chardev_trace_clock(trace_chardev_lock_enabled());
+        ret = chardev_lockstat_lock_err(&my_mutex_stat, my_mutex_since, my_mutex_trylock(),
+                                        my_mutex_lock_interruptible());
+        trace_chardev_lock("my_mutex", "interruptible", ret, chardev_trace_since(start));
         if (ret) {
             pr_warn("mutex_lock_interruptible interrupted by signal\n");
             return -EINTR;
         }
-        pr_info("Got mutex with mutex_lock_interruptible\n");
+        ioctl_lock_taken(file);
+        pr_debug("Got mutex with mutex_lock_interruptible\n");
         break;
     
     case IOCTL_LOCK_KILLABLE:
-        pr_info("Trying mutex_lock_killable (5s sleep)...\n");
+        pr_debug("Trying mutex_lock_killable (5s sleep)...\n");
         msleep(5000);  // Give time to interrupt
-        ret = mutex_lock_killable(&my_mutex);
+        start = chardev_trace_clock(trace_chardev_lock_enabled());
+        ret = chardev_lockstat_lock_err(&my_mutex_stat, my_mutex_since, my_mutex_trylock(),
+                                        my_mutex_lock_killable());
+        trace_chardev_lock("my_mutex", "killable", ret, chardev_trace_since(start));
         if (ret) {
             pr_warn("mutex_lock_killable interrupted by fatal signal\n");
             return -EINTR;
         }
-        pr_info("Got mutex with mutex_lock_killable\n");
+        ioctl_lock_taken(file);
+        pr_debug("Got mutex with mutex_lock_killable\n");
         break;    
 
     case IOCTL_TRYLOCK:
-        pr_info("[IOCTL] mutex_trylock()\n");
-        if (!mutex_trylock(&my_mutex))
-            return -EBUSY;
+        pr_debug("[IOCTL] mutex_trylock()\n");
+        ret = chardev_lockstat_lock_err(&my_mutex_stat, my_mutex_since, my_mutex_trylock(),
+                                        -EBUSY);
+        trace_chardev_lock("my_mutex", "trylock", ret, 0);
+        if (ret)
+            return ret;
+        ioctl_lock_taken(file);
         break;
 
     case IOCTL_IS_LOCKED:
-        status = mutex_is_locked(&my_mutex);
+        status = my_mutex_is_locked();
         if (copy_to_user((int __user *)arg, &status, sizeof(int)))
             return -EFAULT;
         break;
 
     case IOCTL_UNLOCK:
-        pr_info("[IOCTL] mutex_unlock()\n");
-        if (mutex_is_locked(&my_mutex))
-            mutex_unlock(&my_mutex);
+        pr_debug("[IOCTL] mutex_unlock()\n");
+        if (READ_ONCE(ioctl_owner) != current)
+            return -EPERM;
+        ioctl_unlock();
+        break;
+
+    case IOCTL_SET_READ_MODE:
+        if (get_user(status, (int __user *)arg))
+            return -EFAULT;
+        if (status < MUTEX_READ_MUTEX || status > MUTEX_READ_RCU)
+            return -EINVAL;
+        WRITE_ONCE(read_mode, status);
+        pr_debug("[IOCTL] read mode %d\n", status);
+        break;
+
+    case IOCTL_SET_RING_MODE:
+        if (get_user(status, (int __user *)arg))
+            return -EFAULT;
+        if (status < RING_MODE_OFF || status > RING_MODE_MPMC)
+            return -EINVAL;
+        WRITE_ONCE(ring_mode, status);
+        pr_debug("[IOCTL] ring mode %d\n", status);
         break;
 
     default:
@@ -138,6 +416,15 @@ static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
     return 0;
 }
 
+static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    u64 start = ktime_get_ns();
+    long ret = do_dev_ioctl(file, cmd, arg);
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_IOCTL, ret, start);
+
+    trace_chardev_ioctl(cmd, ret, ns);
+    return ret;
+}
+
 static struct file_operations fops = {
     .owner = THIS_MODULE,
     .open = dev_open,
@@ -149,6 +436,32 @@ static struct file_operations fops = {
 
 static int __init mutex_demo_init(void) {
     dev_t dev;
+
+    struct buffer_copy *copy;
+
+    if (chardev_stats_init(&stats, DEVICE_NAME))
+        return -ENOMEM;
+    if (chardev_lockstat_init(&my_mutex_stat, "my_mutex", stats.dir)) {
+        chardev_stats_exit(&stats);
+        return -ENOMEM;
+    }
+
+    if (chardev_lfring_init(&ring, stats.dir)) {
+        chardev_stats_exit(&stats);
+        chardev_lockstat_exit(&my_mutex_stat);
+        return -ENOMEM;
+    }
+
+    copy = kmalloc(sizeof(*copy), GFP_KERNEL);
+    if (!copy) {
+        chardev_stats_exit(&stats);
+        chardev_lfring_exit(&ring);
+        chardev_lockstat_exit(&my_mutex_stat);
+        return -ENOMEM;
+    }
+    memcpy(copy->data, shared_buffer, sizeof(copy->data));
+    RCU_INIT_POINTER(published, copy);
+
     alloc_chrdev_region(&dev, 0, 1, DEVICE_NAME);
     major = MAJOR(dev);
 
@@ -160,7 +473,7 @@ static int __init mutex_demo_init(void) {
 
     mutex_init(&my_mutex);
 
-    pr_info("Mutex driver loaded\n");
+    pr_info("Mutex driver loaded (%s)\n", pi ? "rt_mutex, priority inheritance" : "mutex");
     return 0;
 }
 
@@ -169,6 +482,10 @@ static void __exit mutex_demo_exit(void) {
     class_destroy(cls);
     cdev_del(&my_cdev);
     unregister_chrdev_region(MKDEV(major, 0), 1);
+    chardev_stats_exit(&stats);
+    chardev_lockstat_exit(&my_mutex_stat);
+    chardev_lfring_exit(&ring);
+    kfree(rcu_dereference_protected(published, 1));
     pr_info("Mutex driver unloaded\n");
 }
 
@@ -23,6 +23,23 @@ spin_lock_irqsave()	        Same as above, but saves current flags          Save
 spin_lock_bh()	            Disables bottom halves (soft IRQs) on           Disables soft IRQs
                             current CPU
 
+Code holding a spinlock must not sleep: each command only updates a counter
+under its lock variant (SPIN_ADD adds an arbitrary value with spin_lock()).
+
+Sharded Mode
+
+With one global lock every update from every CPU bounces the same cache line
+and queues on the same lock, so throughput stops scaling at the second core.
+In SPIN_MODE_SHARDED (SPIN_SET_MODE) every CPU has its own counter and lock
+on its own cache line and an update only takes the shard of the CPU it runs
+on. A task may migrate right after picking its shard; that is harmless, as
+the shard's lock still serialises everyone touching it. SPIN_READ_TOTAL pays
+for this instead: it walks and locks every shard (and the global counter).
+
+Wait/hold times and top contenders of the global lock and of the shard locks
+(all shards together) are in /sys/kernel/debug/spinlock_dev/locks/my_lock
+and .../locks/shard (see chardev_lockstat.h).
+
 */
 
 #include <linux/module.h>
@@ -32,70 +49,153 @@ spin_lock_bh()	            Disables bottom halves (soft IRQs) on           Disab
 #include <linux/uaccess.h>
 #include <linux/spinlock.h>
 #include <linux/ioctl.h>
-#include <linux/delay.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+
+#define CREATE_TRACE_POINTS
+#define CHARDEV_TRACE_SYSTEM spinlock_dev
+#include "chardev_trace.h"
+#include "chardev_lockstat.h"
+#include "uapi/chardev_ioctl.h"
 
 #define DEVICE_NAME "spinlock_dev"
 #define CLASS_NAME  "spincls"
 
-#define SPIN_IOCTL_BASE 0xF0
-#define SPIN_LOCK            _IO(SPIN_IOCTL_BASE, 1)
-#define SPIN_LOCK_IRQSAVE    _IO(SPIN_IOCTL_BASE, 2)
-#define SPIN_LOCK_IRQ        _IO(SPIN_IOCTL_BASE, 3)
-#define SPIN_LOCK_BH         _IO(SPIN_IOCTL_BASE, 4)
-
 static int major;
 static struct class* cls;
 static struct cdev my_cdev;
+static struct dentry *debug_dir;
+static struct chardev_lockstat my_lock_stat, shard_stat;
+
+struct spin_shard {
+    spinlock_t lock;
+    u64 sum;
+    u64 updates;
+    struct chardev_lockstat *stat;
+    u64 since;                  // when the current holder took lock
+};
 
-static char shared_data[100] = "Spinlock Protected";
-static spinlock_t my_lock;
+// SPIN_MODE_GLOBAL state, and one shard per CPU for SPIN_MODE_SHARDED
+static struct spin_shard global_shard ____cacheline_aligned_in_smp;
+static DEFINE_PER_CPU_ALIGNED(struct spin_shard, shards);
+static int mode = SPIN_MODE_GLOBAL;
 
 static int dev_open(struct inode *inode, struct file *file) {
-    pr_info("Device opened\n");
+    trace_chardev_open(iminor(inode));
     return 0;
 }
 
 static int dev_release(struct inode *inode, struct file *file) {
-    pr_info("Device closed\n");
+    pr_debug("Device closed\n");
     return 0;
 }
 
-static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+// The shard an update goes to; @name is what the lock tracepoint calls its lock
+static struct spin_shard *pick_shard(const char **name) {
+    if (READ_ONCE(mode) == SPIN_MODE_SHARDED) {
+        *name = "shard";
+        return raw_cpu_ptr(&shards);
+    }
+    *name = "my_lock";
+    return &global_shard;
+}
+
+static void shard_add(struct spin_shard *s, u64 val) {
+    s->sum += val;
+    s->updates++;
+}
+
+// Inlined so every caller shows up as its own site in the lockstat file
+static __always_inline void shard_lock(struct spin_shard *s) {
+    chardev_lockstat_lock(s->stat, s->since, spin_trylock(&s->lock), spin_lock(&s->lock));
+}
+
+static void shard_unlock(struct spin_shard *s) {
+    chardev_lockstat_unlock(s->stat, s->since, spin_unlock(&s->lock));
+}
+
+static void shard_read(struct spin_shard *s, struct spin_total *total) {
+    shard_lock(s);
+    total->sum += s->sum;
+    total->updates += s->updates;
+    shard_unlock(s);
+}
+
+static long do_dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    u64 start = chardev_trace_clock(trace_chardev_lock_enabled());
+    struct spin_total total = { 0 };
+    struct spin_shard *s;
     unsigned long flags;
+    const char *name;
+    int cpu, new_mode;
+    u64 val;
 
     switch (cmd) {
         case SPIN_LOCK:
-            pr_info("[spin_lock] Acquiring lock\n");
-            spin_lock(&my_lock);
-            msleep(2000);
-            pr_info("[spin_lock] Data = %s\n", shared_data);
-            spin_unlock(&my_lock);
+            pr_debug("[spin_lock] Acquiring lock\n");
+            s = pick_shard(&name);
+            shard_lock(s);
+            trace_chardev_lock(name, "spin_lock", 0, chardev_trace_since(start));
+            shard_add(s, 1);
+            shard_unlock(s);
             break;
 
         case SPIN_LOCK_IRQSAVE:
-            pr_info("[irqsave] Acquiring lock\n");
-            spin_lock_irqsave(&my_lock, flags);
-            msleep(2000);
-            pr_info("[irqsave] Data = %s\n", shared_data);
-            spin_unlock_irqrestore(&my_lock, flags);
+            pr_debug("[irqsave] Acquiring lock\n");
+            s = pick_shard(&name);
+            chardev_lockstat_lock(s->stat, s->since, spin_trylock_irqsave(&s->lock, flags),
+                                  spin_lock_irqsave(&s->lock, flags));
+            trace_chardev_lock(name, "irqsave", 0, chardev_trace_since(start));
+            shard_add(s, 1);
+            chardev_lockstat_unlock(s->stat, s->since, spin_unlock_irqrestore(&s->lock, flags));
             break;
 
         case SPIN_LOCK_IRQ:
-            pr_info("[irq] Acquiring lock\n");
+            pr_debug("[irq] Acquiring lock\n");
+            s = pick_shard(&name);
             local_irq_disable();  // manually disable before locking
-            spin_lock(&my_lock);
-            msleep(2000);
-            pr_info("[irq] Data = %s\n", shared_data);
-            spin_unlock(&my_lock);
+            shard_lock(s);
+            trace_chardev_lock(name, "irq", 0, chardev_trace_since(start));
+            shard_add(s, 1);
+            shard_unlock(s);
             local_irq_enable();
             break;
 
         case SPIN_LOCK_BH:
-            pr_info("[bh] Acquiring lock\n");
-            spin_lock_bh(&my_lock);
-            msleep(2000);
-            pr_info("[bh] Data = %s\n", shared_data);
-            spin_unlock_bh(&my_lock);
+            pr_debug("[bh] Acquiring lock\n");
+            s = pick_shard(&name);
+            chardev_lockstat_lock(s->stat, s->since, spin_trylock_bh(&s->lock),
+                                  spin_lock_bh(&s->lock));
+            trace_chardev_lock(name, "bh", 0, chardev_trace_since(start));
+            shard_add(s, 1);
+            chardev_lockstat_unlock(s->stat, s->since, spin_unlock_bh(&s->lock));
+            break;
+
+        case SPIN_ADD:
+            if (get_user(val, (u64 __user *)arg))
+                return -EFAULT;
+            s = pick_shard(&name);
+            shard_lock(s);
+            trace_chardev_lock(name, "add", 0, chardev_trace_since(start));
+            shard_add(s, val);
+            shard_unlock(s);
+            break;
+
+        case SPIN_READ_TOTAL:
+            shard_read(&global_shard, &total);
+            for_each_possible_cpu(cpu)
+                shard_read(per_cpu_ptr(&shards, cpu), &total);
+            if (copy_to_user((struct spin_total __user *)arg, &total, sizeof(total)))
+                return -EFAULT;
+            break;
+
+        case SPIN_SET_MODE:
+            if (get_user(new_mode, (int __user *)arg))
+                return -EFAULT;
+            if (new_mode != SPIN_MODE_GLOBAL && new_mode != SPIN_MODE_SHARDED)
+                return -EINVAL;
+            WRITE_ONCE(mode, new_mode);
+            pr_debug("Mode %s\n", new_mode == SPIN_MODE_SHARDED ? "sharded" : "global");
             break;
 
         default:
@@ -104,6 +204,14 @@ static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
     return 0;
 }
 
+static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
+    u64 start = chardev_trace_clock(trace_chardev_ioctl_enabled());
+    long ret = do_dev_ioctl(file, cmd, arg);
+
+    trace_chardev_ioctl(cmd, ret, chardev_trace_since(start));
+    return ret;
+}
+
 static struct file_operations fops = {
     .owner = THIS_MODULE,
     .unlocked_ioctl = dev_ioctl,
@@ -113,6 +221,21 @@ static struct file_operations fops = {
 
 static int __init spin_init(void) {
     dev_t dev;
+    int cpu;
+
+    debug_dir = debugfs_create_dir(DEVICE_NAME, NULL);
+    if (chardev_lockstat_init(&my_lock_stat, "my_lock", debug_dir))
+        goto r_lockstat;
+    if (chardev_lockstat_init(&shard_stat, "shard", debug_dir))
+        goto r_lockstat;
+
+    spin_lock_init(&global_shard.lock);
+    global_shard.stat = &my_lock_stat;
+    for_each_possible_cpu(cpu) {
+        spin_lock_init(&per_cpu_ptr(&shards, cpu)->lock);
+        per_cpu_ptr(&shards, cpu)->stat = &shard_stat;
+    }
+
     alloc_chrdev_region(&dev, 0, 1, DEVICE_NAME);
     major = MAJOR(dev);
 
@@ -122,9 +245,13 @@ static int __init spin_init(void) {
     cls = class_create(CLASS_NAME);
     device_create(cls, NULL, dev, NULL, DEVICE_NAME);
 
-    spin_lock_init(&my_lock);
     pr_info("Spinlock driver loaded\n");
     return 0;
+
+r_lockstat:
+    debugfs_remove_recursive(debug_dir);
+    chardev_lockstat_exit(&my_lock_stat);   // not allocated if it was the one that failed
+    return -ENOMEM;
 }
 
 static void __exit spin_exit(void) {
@@ -132,6 +259,9 @@ static void __exit spin_exit(void) {
     class_destroy(cls);
     cdev_del(&my_cdev);
     unregister_chrdev_region(MKDEV(major, 0), 1);
+    debugfs_remove_recursive(debug_dir);
+    chardev_lockstat_exit(&shard_stat);
+    chardev_lockstat_exit(&my_lock_stat);
     pr_info("Spinlock driver unloaded\n");
 }
 
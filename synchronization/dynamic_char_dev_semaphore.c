@@ -1,20 +1,60 @@
-/* 
+/*
 Semaphore:
 
 down() – blocks unconditionally until the semaphore is available
 down_interruptible() – blocks but can be interrupted by signals
+down_killable() – blocks, only a fatal signal interrupts it
 down_trylock() – doesn't block; immediately returns if it can't get the lock.
+down_timeout() – blocks for at most the given number of jiffies
 
 Summary Table
 API     	                Blocks?	        Preemptible?	    Interruptible?      Return Value
 down()	                      Yes	            No	                No	            void (always blocks)
 down_interruptible()	      Yes	            No	                Yes	            0 on success, -ERESTARTSYS if signal
+down_killable()	              Yes	            No	                Fatal only	    0 on success, -EINTR if killed
 down_trylock()	              No	            N/A	                N/A	            0 success, non-zero fail
+down_timeout()	              Yes	            No	                No	            0 on success, -ETIME on timeout
+
+Acquire Policy
+
+Each open file picks how its read()s and write()s acquire the semaphore with
+SEM_IOCTL_SET_POLICY: down, interruptible (the default), killable, trylock or
+timeout. hold_us keeps the semaphore that much longer per access to emulate
+real work; the 5 s sleep this demo used to hard-code is hold_us = 5000000.
+
+Slot Pool
+
+The semaphore counts the free slots of a pool (SEM_IOCTL_SET_SLOTS; 1, the
+default, is a binary semaphore). Each slot is a bounce buffer: a read copies
+shared_buffer into its slot under a spinlock and copies to user space from
+the slot; a write copies from user space into its slot and then publishes
+the whole slot as the new shared_buffer. Up to N tasks overlap their slow,
+possibly faulting user copies; only the short memcpy()s serialise. A resize
+first takes every slot of the old pool, so it waits for the accesses in flight.
+
+Ring Mode
+
+SEM_IOCTL_SET_RING replaces the pool and shared_buffer with a lockless ring
+for streaming (see chardev_lfring.h): writes append, reads drain, and a full
+or empty ring blocks or, with O_NONBLOCK, returns -EAGAIN. The semaphore and
+the acquire policy are not involved; RING_MODE_OFF goes back to the pool.
+
+Statistics
+
+Every access records how long it waited for its slot and how long it held it,
+and who contended for one (see chardev_lockstat.h):
+
+    /sys/kernel/debug/sem_variants/locks/sem       wait/hold histograms, top
+                                                   contenders; write to clear
+    /sys/kernel/debug/sem_variants/acquire         pool usage, failures by kind
+    /sys/kernel/debug/sem_variants/acquire_reset   write anything to clear them
 
 test Steps:
-echo "Critical Code" | sudo tee /dev/sem_variants 
+echo "Critical Code" | sudo tee /dev/sem_variants
 sudo cat /dev/sem_variants
 
+sudo ./test_sem interruptible 5000000   # hold the semaphore for 5 s
+sudo cat /dev/sem_variants              # from another terminal: waits
 ps aux | grep 'cat /dev/sem_variants'   # Get PID
 sudo kill -SIGINT <pid>                 # Send Ctrl+C equivalent
 
@@ -27,92 +67,405 @@ sudo kill -SIGINT <pid>                 # Send Ctrl+C equivalent
 #include <linux/semaphore.h>
 #include <linux/sched/signal.h>
 #include <linux/delay.h>
+#include <linux/bitmap.h>
+#include <linux/percpu.h>
+
+#define CREATE_TRACE_POINTS
+#define CHARDEV_TRACE_SYSTEM sem_variants
+#include "chardev_trace.h"
+#include "chardev_stats.h"
+#include "chardev_lockstat.h"
+#include "chardev_lfring.h"
+#include "uapi/chardev_ioctl.h"
 
 #define DEVICE_NAME "sem_variants"
 #define CLASS_NAME  "semcls"
 
+#define SEM_DEFAULT_SLOTS   1
+#define SEM_MAX_SLOTS       1024
+#define SEM_MAX_TIMEOUT_MS  60000
+#define SEM_MAX_HOLD_US     (10 * USEC_PER_SEC)
+
 static int major;
 static struct class* cls;
 static struct cdev my_cdev;
 
-static struct semaphore sem;
+static struct semaphore sem;                // counts the free slots
 static char shared_buffer[100] = "Initial Data";
+static DEFINE_SPINLOCK(buffer_lock);        // guards shared_buffer and slot_used
+static struct chardev_stats stats;
+static struct chardev_lockstat sem_stat;
+static struct chardev_lfring ring;
+static int ring_mode = RING_MODE_OFF;
 
-ssize_t read_down(struct file *filep, char __user *buf, size_t len, loff_t *offset);
-ssize_t read_interruptible(struct file *filep, char __user *buf, size_t len, loff_t *offset);
-ssize_t read_try_lock(struct file *filep, char __user *buf, size_t len, loff_t *offset);
+struct sem_slot {
+    char data[sizeof(shared_buffer)];
+};
+
+// Only replaced by pool_resize() while it owns every slot
+static struct sem_slot *slots;
+static unsigned long *slot_used;
+static unsigned int nr_slots;
+static DEFINE_MUTEX(pool_lock);             // serialises resizes
+
+struct sem_acquire_stats {
+    u64 busy;           // trylock found no free slot
+    u64 timeouts;
+    u64 interrupted;
+};
+
+static struct sem_acquire_stats __percpu *acq_stats;
+
+static const char * const policy_names[] = {
+    [SEM_POLICY_DOWN]           = "down",
+    [SEM_POLICY_INTERRUPTIBLE]  = "interruptible",
+    [SEM_POLICY_KILLABLE]       = "killable",
+    [SEM_POLICY_TRYLOCK]        = "trylock",
+    [SEM_POLICY_TIMEOUT]        = "timeout",
+};
 
 static int dev_open(struct inode *inodep, struct file *filep) {
-    pr_info("Device opened\n");
+    struct sem_policy *pol = kzalloc(sizeof(*pol), GFP_KERNEL);
+
+    if (!pol)
+        return -ENOMEM;
+    pol->policy = SEM_POLICY_INTERRUPTIBLE;
+    filep->private_data = pol;
+    trace_chardev_open(iminor(inodep));
     return 0;
 }
 
 static int dev_release(struct inode *inodep, struct file *filep) {
-    pr_info("Device released\n");
+    kfree(filep->private_data);
+    pr_debug("Device released\n");
     return 0;
 }
 
-// down() variant
-ssize_t read_down(struct file *filep, char __user *buf, size_t len, loff_t *offset) {
-    pr_info("[down] Trying to acquire semaphore\n");
-    down(&sem);  // blocks unconditionally
-    pr_info("[down] Got semaphore, reading...\n");
-    ssize_t ret = simple_read_from_buffer(buf, len, offset, shared_buffer, sizeof(shared_buffer));
-    up(&sem);
-    return ret;
+// The slow path of slot_acquire(), once down_trylock() found no free slot
+static int sem_down(const struct sem_policy *pol) {
+    switch (pol->policy) {
+    case SEM_POLICY_DOWN:
+        down(&sem);
+        return 0;
+    case SEM_POLICY_INTERRUPTIBLE:
+        return down_interruptible(&sem) ? -ERESTARTSYS : 0;
+    case SEM_POLICY_KILLABLE:
+        return down_killable(&sem);
+    case SEM_POLICY_TIMEOUT:
+        return down_timeout(&sem, msecs_to_jiffies(pol->timeout_ms));
+    default:
+        return -EBUSY;
+    }
 }
 
-ssize_t read_interruptible(struct file *filep, char __user *buf, size_t len, loff_t *offset) {
-    pr_info("[interruptible] Trying to acquire semaphore\n");
+/*
+ * Take a free slot the way @pol says. Returns its index and when it was
+ * granted, or -ERESTARTSYS (interruptible), -EINTR (killable), -EBUSY
+ * (trylock) or -ETIME (timeout). Inlined so reads and writes show up as
+ * separate sites in locks/sem.
+ */
+static __always_inline int slot_acquire(const struct sem_policy *pol, u64 *since) {
+    u64 start = chardev_trace_clock(trace_chardev_lock_enabled());
+    int err, idx;
+
+    pr_debug("[%s] Trying to acquire semaphore\n", policy_names[pol->policy]);
+    err = chardev_lockstat_lock_err(&sem_stat, *since, !down_trylock(&sem), sem_down(pol));
+    trace_chardev_lock("sem", policy_names[pol->policy], err, chardev_trace_since(start));
 
-    // Attempt to acquire immediately
-    if (down_interruptible(&sem)) {
-        pr_warn("[interruptible] Interrupted by signal!\n");
-        return -ERESTARTSYS;
+    if (err == -EBUSY)
+        this_cpu_inc(acq_stats->busy);
+    else if (err == -ETIME)
+        this_cpu_inc(acq_stats->timeouts);
+    else if (err)
+        this_cpu_inc(acq_stats->interrupted);
+    if (err) {
+        pr_debug("[%s] Failed: %d\n", policy_names[pol->policy], err);
+        return err;
     }
 
-    pr_info("[interruptible] Got semaphore, sleeping...\n");
-    ssleep(5);  // Sleep after acquiring semaphore
+    // Holding a count guarantees a free slot
+    spin_lock(&buffer_lock);
+    idx = find_first_zero_bit(slot_used, nr_slots);
+    __set_bit(idx, slot_used);
+    spin_unlock(&buffer_lock);
+    return idx;
+}
+
+static void slot_release(int idx, u64 since, u32 hold_us) {
+    if (hold_us)
+        fsleep(hold_us);
+
+    spin_lock(&buffer_lock);
+    __clear_bit(idx, slot_used);
+    spin_unlock(&buffer_lock);
+    chardev_lockstat_unlock(&sem_stat, since, up(&sem));
+}
 
-    ssize_t ret = simple_read_from_buffer(buf, len, offset, shared_buffer, sizeof(shared_buffer));
-    up(&sem);
+static ssize_t do_dev_read(struct file *filep, char __user *buf, size_t len, loff_t *offset) {
+    struct sem_policy pol = *(struct sem_policy *)filep->private_data;
+    int mode = READ_ONCE(ring_mode);
+    struct sem_slot *slot;
+    ssize_t ret;
+    u64 since;
+    int idx;
+
+    if (mode != RING_MODE_OFF)
+        return chardev_lfring_read(&ring, mode, buf, len, filep->f_flags & O_NONBLOCK);
+
+    idx = slot_acquire(&pol, &since);
+    if (idx < 0)
+        return idx;
+    slot = &slots[idx];
+
+    spin_lock(&buffer_lock);
+    memcpy(slot->data, shared_buffer, sizeof(slot->data));
+    spin_unlock(&buffer_lock);
+    ret = simple_read_from_buffer(buf, len, offset, slot->data, sizeof(slot->data));
+
+    slot_release(idx, since, pol.hold_us);
     return ret;
 }
 
-// down_trylock() variant
-ssize_t read_try_lock(struct file *filep, char __user *buf, size_t len, loff_t *offset) {
-    pr_info("[trylock] Trying to acquire semaphore\n");
-    if (down_trylock(&sem)) {
-        pr_warn("[trylock] Could not acquire, resource busy!\n");
-        return -EBUSY;
+// Entry point: account every read in the per-CPU stats, then trace it
+static ssize_t dev_read(struct file *filep, char __user *buf, size_t len, loff_t *offset) {
+    loff_t pos = *offset;
+    u64 start = ktime_get_ns();
+    ssize_t ret = do_dev_read(filep, buf, len, offset);
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_READ, ret, start);
+
+    trace_chardev_read(pos, ret, ns);
+    return ret;
+}
+
+static ssize_t do_dev_write(struct file *filep, const char __user *buf, size_t len, loff_t *offset) {
+    struct sem_policy pol = *(struct sem_policy *)filep->private_data;
+    int mode = READ_ONCE(ring_mode);
+    struct sem_slot *slot;
+    ssize_t ret;
+    u64 since;
+    int idx;
+
+    pr_debug("Write request received\n");
+    if (mode != RING_MODE_OFF)
+        return chardev_lfring_write(&ring, mode, buf, len, filep->f_flags & O_NONBLOCK);
+
+    idx = slot_acquire(&pol, &since);
+    if (idx < 0)
+        return idx;
+    slot = &slots[idx];
+
+    // Start from the current contents so a write at an offset keeps the rest
+    spin_lock(&buffer_lock);
+    memcpy(slot->data, shared_buffer, sizeof(slot->data));
+    spin_unlock(&buffer_lock);
+    ret = simple_write_to_buffer(slot->data, sizeof(slot->data), offset, buf, len);
+    if (ret > 0) {
+        spin_lock(&buffer_lock);
+        memcpy(shared_buffer, slot->data, sizeof(shared_buffer));
+        spin_unlock(&buffer_lock);
+        pr_debug("Updated buffer through slot %d\n", idx);
     }
-    pr_info("[trylock] Got semaphore, reading...\n");
-    ssize_t ret = simple_read_from_buffer(buf, len, offset, shared_buffer, sizeof(shared_buffer));
-    up(&sem);
+
+    slot_release(idx, since, pol.hold_us);
     return ret;
 }
 
 static ssize_t dev_write(struct file *filep, const char __user *buf, size_t len, loff_t *offset) {
-    pr_info("Write request received\n");
-    down(&sem);  // Simple protection
-    ssize_t ret = simple_write_to_buffer(shared_buffer, sizeof(shared_buffer), offset, buf, len);
-    pr_info("Updated buffer: %s\n", shared_buffer);
-    up(&sem);
+    u64 start = ktime_get_ns();
+    loff_t pos = *offset;
+    ssize_t ret = do_dev_write(filep, buf, len, offset);
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_WRITE, ret, start);
+
+    trace_chardev_write(pos, ret, ns);
+    return ret;
+}
+
+// Give the semaphore @n slots; waits until every slot of the old pool is free
+static int pool_resize(unsigned int n) {
+    struct sem_slot *new_slots = kcalloc(n, sizeof(*new_slots), GFP_KERNEL);
+    unsigned long *new_used = bitmap_zalloc(n, GFP_KERNEL);
+    unsigned int i;
+    int ret = 0;
+
+    if (!new_slots || !new_used) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    if (mutex_lock_killable(&pool_lock)) {
+        ret = -EINTR;
+        goto out;
+    }
+    for (i = 0; i < nr_slots; i++) {
+        if (down_killable(&sem)) {
+            while (i--)
+                up(&sem);
+            mutex_unlock(&pool_lock);
+            ret = -EINTR;
+            goto out;
+        }
+    }
+
+    // Nobody holds a slot now: swap the pool, then hand out the new count
+    spin_lock(&buffer_lock);
+    swap(slots, new_slots);
+    swap(slot_used, new_used);
+    WRITE_ONCE(nr_slots, n);
+    spin_unlock(&buffer_lock);
+    for (i = 0; i < n; i++)
+        up(&sem);
+    mutex_unlock(&pool_lock);
+    pr_debug("Pool resized to %u slots\n", n);
+
+out:
+    kfree(new_slots);
+    bitmap_free(new_used);
+    return ret;
+}
+
+static long do_dev_ioctl(struct file *filep, unsigned int cmd, unsigned long arg) {
+    struct sem_policy *pol = filep->private_data, new;
+    int n;
+
+    switch (cmd) {
+    case SEM_IOCTL_SET_POLICY:
+        if (copy_from_user(&new, (void __user *)arg, sizeof(new)))
+            return -EFAULT;
+        if (new.policy >= ARRAY_SIZE(policy_names) || new.hold_us > SEM_MAX_HOLD_US ||
+            (new.policy == SEM_POLICY_TIMEOUT &&
+             (!new.timeout_ms || new.timeout_ms > SEM_MAX_TIMEOUT_MS)))
+            return -EINVAL;
+        new.reserved = 0;
+        *pol = new;
+        return 0;
+
+    case SEM_IOCTL_GET_POLICY:
+        if (copy_to_user((void __user *)arg, pol, sizeof(*pol)))
+            return -EFAULT;
+        return 0;
+
+    case SEM_IOCTL_SET_SLOTS:
+        if (get_user(n, (int __user *)arg))
+            return -EFAULT;
+        if (n < 1 || n > SEM_MAX_SLOTS)
+            return -EINVAL;
+        return pool_resize(n);
+
+    case SEM_IOCTL_GET_SLOTS:
+        return put_user(READ_ONCE(nr_slots), (int __user *)arg);
+
+    case SEM_IOCTL_SET_RING:
+        if (get_user(n, (int __user *)arg))
+            return -EFAULT;
+        if (n < RING_MODE_OFF || n > RING_MODE_MPMC)
+            return -EINVAL;
+        WRITE_ONCE(ring_mode, n);
+        return 0;
+
+    default:
+        return -ENOTTY;
+    }
+}
+
+static long dev_ioctl(struct file *filep, unsigned int cmd, unsigned long arg) {
+    u64 start = ktime_get_ns();
+    long ret = do_dev_ioctl(filep, cmd, arg);
+    u64 ns = chardev_stats_record(&stats, CHARDEV_OP_IOCTL, ret, start);
+
+    trace_chardev_ioctl(cmd, ret, ns);
     return ret;
 }
 
+static int acquire_show(struct seq_file *m, void *v) {
+    struct sem_acquire_stats *sum;
+    unsigned int in_use, total;
+    int cpu;
+
+    sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+    if (!sum)
+        return -ENOMEM;
+    for_each_possible_cpu(cpu) {
+        struct sem_acquire_stats *c = per_cpu_ptr(acq_stats, cpu);
+
+        sum->busy += READ_ONCE(c->busy);
+        sum->timeouts += READ_ONCE(c->timeouts);
+        sum->interrupted += READ_ONCE(c->interrupted);
+    }
+
+    spin_lock(&buffer_lock);
+    total = nr_slots;
+    in_use = bitmap_weight(slot_used, nr_slots);
+    spin_unlock(&buffer_lock);
+
+    seq_printf(m, "slots %u, in use %u\n", total, in_use);
+    seq_printf(m, "busy %llu, timeouts %llu, interrupted %llu\n",
+               sum->busy, sum->timeouts, sum->interrupted);
+    kfree(sum);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(acquire);
+
+static ssize_t acquire_reset_write(struct file *file, const char __user *buf,
+                                   size_t len, loff_t *ppos) {
+    int cpu;
+
+    for_each_possible_cpu(cpu)
+        memset(per_cpu_ptr(acq_stats, cpu), 0, sizeof(struct sem_acquire_stats));
+    return len;
+}
+
+static const struct file_operations acquire_reset_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .write = acquire_reset_write,
+    .llseek = noop_llseek,
+};
+
 static struct file_operations fops = {
     .owner = THIS_MODULE,
     .open = dev_open,
     .release = dev_release,
     .write = dev_write,
-    .read = read_interruptible // <--- Switch here to test: read_down, read_trylock
-    // .read = read_down
-    // .read = read_try_lock
+    .read = dev_read,
+    .unlocked_ioctl = dev_ioctl,
 };
 
 static int __init sem_demo_init(void) {
     dev_t dev;
+
+    acq_stats = alloc_percpu(struct sem_acquire_stats);
+    if (!acq_stats)
+        return -ENOMEM;
+    // An empty pool, then grow it like SEM_IOCTL_SET_SLOTS would
+    sema_init(&sem, 0);
+    if (pool_resize(SEM_DEFAULT_SLOTS)) {
+        free_percpu(acq_stats);
+        return -ENOMEM;
+    }
+    if (chardev_stats_init(&stats, DEVICE_NAME)) {
+        kfree(slots);
+        bitmap_free(slot_used);
+        free_percpu(acq_stats);
+        return -ENOMEM;
+    }
+    if (chardev_lockstat_init(&sem_stat, "sem", stats.dir)) {
+        chardev_stats_exit(&stats);
+        kfree(slots);
+        bitmap_free(slot_used);
+        free_percpu(acq_stats);
+        return -ENOMEM;
+    }
+    if (chardev_lfring_init(&ring, stats.dir)) {
+        chardev_stats_exit(&stats);
+        chardev_lockstat_exit(&sem_stat);
+        kfree(slots);
+        bitmap_free(slot_used);
+        free_percpu(acq_stats);
+        return -ENOMEM;
+    }
+    debugfs_create_file("acquire", 0444, stats.dir, NULL, &acquire_fops);
+    debugfs_create_file("acquire_reset", 0200, stats.dir, NULL, &acquire_reset_fops);
+
     alloc_chrdev_region(&dev, 0, 1, DEVICE_NAME);
     major = MAJOR(dev);
 
@@ -122,7 +475,6 @@ static int __init sem_demo_init(void) {
     cls = class_create(CLASS_NAME);
     device_create(cls, NULL, dev, NULL, DEVICE_NAME);
 
-    sema_init(&sem, 1);
     pr_info("Semaphore demo driver loaded\n");
     return 0;
 }
@@ -132,6 +484,12 @@ static void __exit sem_demo_exit(void) {
     class_destroy(cls);
     cdev_del(&my_cdev);
     unregister_chrdev_region(MKDEV(major, 0), 1);
+    chardev_stats_exit(&stats);
+    chardev_lockstat_exit(&sem_stat);
+    chardev_lfring_exit(&ring);
+    kfree(slots);
+    bitmap_free(slot_used);
+    free_percpu(acq_stats);
     pr_info("Semaphore demo driver unloaded\n");
 }
 
@@ -140,4 +498,4 @@ module_exit(sem_demo_exit);
 
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("ChatGPT");
-MODULE_DESCRIPTION("Semaphore variants: down, down_interruptible, down_trylock");
\ No newline at end of file
+MODULE_DESCRIPTION("Semaphore variants: per-file acquire policy over a pool of slots");
@@ -0,0 +1,531 @@
+/* Lock contention benchmark
+
+The other drivers in this directory each show one primitive; this module
+measures them against each other. IOCTL_LOCK_BENCH_RUN spawns N kthreads,
+pinned round-robin to the online CPUs, that hammer one shared critical
+section for duration_ms:
+
+    acquire (timed) -> cs_loops accesses to one shared cache line -> release
+    -> gap_loops cpu_relax()es -> repeat
+
+Primitives (enum lock_bench_primitive in uapi/chardev_ioctl.h):
+
+    spinlock, mutex, semaphore      every acquisition is exclusive
+    rwsem, rwlock, percpu_rwsem     read_pct% of acquisitions are shared
+    seqlock                         readers retry instead of locking
+    rcu                             readers only rcu_read_lock(); writers copy
+                                    the data, publish the copy under a spinlock
+                                    and free the old one with kfree_rcu()
+
+For the lockless readers (seqlock, RCU) "acquire" is the cost of entering
+the read side; a seqlock reader's retries count as critical section time.
+
+The ioctl blocks for the run and returns a struct lock_bench_result. The
+last LOCK_BENCH_HISTORY runs are also listed in debugfs, one line each:
+throughput, mean ns per acquire, per-thread min/max acquisitions and Jain's
+fairness index.
+
+    sudo ./run_lock_bench                      (synchronization/user-application)
+    cat /sys/kernel/debug/lock_bench/results
+    echo > /sys/kernel/debug/lock_bench/reset
+*/
+
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/uaccess.h>
+#include <linux/kthread.h>
+#include <linux/delay.h>
+#include <linux/slab.h>
+#include <linux/random.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/wait_bit.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/semaphore.h>
+#include <linux/rwsem.h>
+#include <linux/seqlock.h>
+#include <linux/percpu-rwsem.h>
+#include <linux/rcupdate.h>
+
+#include "uapi/chardev_ioctl.h"
+
+#define DEVICE_NAME "lock_bench"
+#define CLASS_NAME  "lockbenchcls"
+
+#define LOCK_BENCH_MAX_THREADS  256
+#define LOCK_BENCH_MAX_MS       60000
+#define LOCK_BENCH_HISTORY      64
+#define CS_WORDS                (SMP_CACHE_BYTES / sizeof(u64))
+
+static dev_t dev_num;
+static struct class *dev_class;
+static struct device *dev_device;
+static struct cdev my_cdev;
+static struct dentry *debug_dir;
+
+static const char * const primitive_names[LOCK_BENCH_NR_PRIMITIVES] = {
+    [LOCK_BENCH_SPINLOCK]       = "spinlock",
+    [LOCK_BENCH_MUTEX]          = "mutex",
+    [LOCK_BENCH_SEMAPHORE]      = "semaphore",
+    [LOCK_BENCH_RWSEM]          = "rwsem",
+    [LOCK_BENCH_RWLOCK]         = "rwlock",
+    [LOCK_BENCH_SEQLOCK]        = "seqlock",
+    [LOCK_BENCH_PERCPU_RWSEM]   = "percpu_rwsem",
+    [LOCK_BENCH_RCU]            = "rcu",
+};
+
+// The primitives under test; all of them guard shared_data (RCU: rcu_copy)
+static DEFINE_SPINLOCK(bench_spinlock);
+static DEFINE_MUTEX(bench_mutex);
+static DEFINE_SEMAPHORE(bench_sem, 1);
+static DECLARE_RWSEM(bench_rwsem);
+static DEFINE_RWLOCK(bench_rwlock);
+static DEFINE_SEQLOCK(bench_seqlock);
+DEFINE_STATIC_PERCPU_RWSEM(bench_percpu_rwsem);
+
+static struct {
+    u64 word[CS_WORDS];
+} shared_data ____cacheline_aligned_in_smp;
+
+struct bench_copy {
+    struct rcu_head rcu;
+    u64 word[CS_WORDS];
+};
+
+static struct bench_copy __rcu *rcu_copy;
+static DEFINE_SPINLOCK(rcu_writer_lock);
+
+struct bench_thread {
+    struct task_struct *task;
+    u64 ops;
+    u64 acquire_ns;
+    u32 seed;
+} ____cacheline_aligned_in_smp;
+
+// State of the run in flight; run_lock allows one at a time
+static DEFINE_MUTEX(run_lock);
+static struct lock_bench_params params;
+static atomic_t ready;
+static bool go, stop;
+
+struct bench_record {
+    struct lock_bench_params params;
+    struct lock_bench_result result;
+};
+
+static DEFINE_MUTEX(history_lock);
+static struct bench_record history[LOCK_BENCH_HISTORY];
+static unsigned int history_len, history_next;
+
+static void cs_write(u64 *word, u32 loops)
+{
+    u32 i;
+
+    for (i = 0; i < loops; i++)
+        WRITE_ONCE(word[i % CS_WORDS], word[i % CS_WORDS] + 1);
+}
+
+static void cs_read(const u64 *word, u32 loops)
+{
+    u32 i;
+
+    for (i = 0; i < loops; i++)
+        (void)READ_ONCE(word[i % CS_WORDS]);
+}
+
+/*
+ * One acquisition of the primitive under test; adds the wait to @acquire_ns.
+ * Returns false if an RCU update could not allocate its copy.
+ */
+static bool bench_once(bool read, u64 *acquire_ns)
+{
+    u32 loops = params.cs_loops;
+    struct bench_copy *copy = NULL, *old;
+    unsigned int seq;
+    u64 start;
+
+    // An RCU update allocates its new copy before it competes for anything
+    if (params.primitive == LOCK_BENCH_RCU && !read) {
+        copy = kmalloc(sizeof(*copy), GFP_KERNEL);
+        if (!copy)
+            return false;
+    }
+    start = ktime_get_ns();
+
+    switch (params.primitive) {
+    case LOCK_BENCH_SPINLOCK:
+        spin_lock(&bench_spinlock);
+        *acquire_ns += ktime_get_ns() - start;
+        cs_write(shared_data.word, loops);
+        spin_unlock(&bench_spinlock);
+        break;
+
+    case LOCK_BENCH_MUTEX:
+        mutex_lock(&bench_mutex);
+        *acquire_ns += ktime_get_ns() - start;
+        cs_write(shared_data.word, loops);
+        mutex_unlock(&bench_mutex);
+        break;
+
+    case LOCK_BENCH_SEMAPHORE:
+        down(&bench_sem);
+        *acquire_ns += ktime_get_ns() - start;
+        cs_write(shared_data.word, loops);
+        up(&bench_sem);
+        break;
+
+    case LOCK_BENCH_RWSEM:
+        if (read) {
+            down_read(&bench_rwsem);
+            *acquire_ns += ktime_get_ns() - start;
+            cs_read(shared_data.word, loops);
+            up_read(&bench_rwsem);
+        } else {
+            down_write(&bench_rwsem);
+            *acquire_ns += ktime_get_ns() - start;
+            cs_write(shared_data.word, loops);
+            up_write(&bench_rwsem);
+        }
+        break;
+
+    case LOCK_BENCH_RWLOCK:
+        if (read) {
+            read_lock(&bench_rwlock);
+            *acquire_ns += ktime_get_ns() - start;
+            cs_read(shared_data.word, loops);
+            read_unlock(&bench_rwlock);
+        } else {
+            write_lock(&bench_rwlock);
+            *acquire_ns += ktime_get_ns() - start;
+            cs_write(shared_data.word, loops);
+            write_unlock(&bench_rwlock);
+        }
+        break;
+
+    case LOCK_BENCH_SEQLOCK:
+        if (read) {
+            seq = read_seqbegin(&bench_seqlock);
+            *acquire_ns += ktime_get_ns() - start;
+            for (;;) {
+                cs_read(shared_data.word, loops);
+                if (!read_seqretry(&bench_seqlock, seq))
+                    break;
+                seq = read_seqbegin(&bench_seqlock);
+            }
+        } else {
+            write_seqlock(&bench_seqlock);
+            *acquire_ns += ktime_get_ns() - start;
+            cs_write(shared_data.word, loops);
+            write_sequnlock(&bench_seqlock);
+        }
+        break;
+
+    case LOCK_BENCH_PERCPU_RWSEM:
+        if (read) {
+            percpu_down_read(&bench_percpu_rwsem);
+            *acquire_ns += ktime_get_ns() - start;
+            cs_read(shared_data.word, loops);
+            percpu_up_read(&bench_percpu_rwsem);
+        } else {
+            percpu_down_write(&bench_percpu_rwsem);
+            *acquire_ns += ktime_get_ns() - start;
+            cs_write(shared_data.word, loops);
+            percpu_up_write(&bench_percpu_rwsem);
+        }
+        break;
+
+    case LOCK_BENCH_RCU:
+        if (read) {
+            rcu_read_lock();
+            *acquire_ns += ktime_get_ns() - start;
+            cs_read(rcu_dereference(rcu_copy)->word, loops);
+            rcu_read_unlock();
+        } else {
+            spin_lock(&rcu_writer_lock);
+            *acquire_ns += ktime_get_ns() - start;
+            old = rcu_dereference_protected(rcu_copy, lockdep_is_held(&rcu_writer_lock));
+            memcpy(copy->word, old->word, sizeof(copy->word));
+            cs_write(copy->word, loops);
+            rcu_assign_pointer(rcu_copy, copy);
+            spin_unlock(&rcu_writer_lock);
+            kfree_rcu(old, rcu);
+        }
+        break;
+    }
+    return true;
+}
+
+static int bench_thread_fn(void *data)
+{
+    struct bench_thread *t = data;
+    // rwsem and every primitive after it has a read side
+    bool rw = params.read_pct && params.primitive >= LOCK_BENCH_RWSEM;
+    u32 x = t->seed, i;
+
+    atomic_inc(&ready);
+    wake_up_var(&ready);
+    wait_var_event(&go, READ_ONCE(go));
+
+    while (!READ_ONCE(stop)) {
+        bool read = false;
+
+        if (rw) {
+            // xorshift32: a shared RNG would be a contention point of its own
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            read = x % 100 < params.read_pct;
+        }
+        if (bench_once(read, &t->acquire_ns))
+            t->ops++;
+        for (i = 0; i < params.gap_loops; i++)
+            cpu_relax();
+        cond_resched();
+    }
+    return 0;
+}
+
+// Jain's index (sum x)^2 / (n * sum x^2), x1000, with x scaled so nothing overflows
+static u32 jain_fairness(const struct bench_thread *threads, unsigned int n, u64 max)
+{
+    u64 div = max / 65536 + 1, sum = 0, sumsq = 0;
+    unsigned int i;
+
+    for (i = 0; i < n; i++) {
+        u64 x = threads[i].ops / div;
+
+        sum += x;
+        sumsq += x * x;
+    }
+    return sumsq ? div64_u64(sum * sum * 1000, n * sumsq) : 1000;
+}
+
+static int bench_run(struct lock_bench_run *run)
+{
+    struct lock_bench_result *r = &run->result;
+    unsigned int i, n, ncpus = num_online_cpus();
+    struct bench_thread *threads;
+    u64 start, acquire_ns = 0;
+    int ret = 0;
+
+    threads = kcalloc(run->params.threads, sizeof(*threads), GFP_KERNEL);
+    if (!threads)
+        return -ENOMEM;
+
+    params = run->params;
+    atomic_set(&ready, 0);
+    WRITE_ONCE(go, false);
+    WRITE_ONCE(stop, false);
+
+    for (n = 0; n < params.threads; n++) {
+        struct task_struct *task;
+
+        threads[n].seed = get_random_u32() | 1;
+        task = kthread_create(bench_thread_fn, &threads[n], "lock_bench/%u", n);
+        if (IS_ERR(task)) {
+            ret = PTR_ERR(task);
+            break;
+        }
+        kthread_bind(task, cpumask_nth(n % ncpus, cpu_online_mask));
+        // The thread may return before kthread_stop_put() gets to it
+        threads[n].task = get_task_struct(task);
+        wake_up_process(task);
+    }
+
+    // Release every thread at once so none gets a head start
+    wait_var_event(&ready, atomic_read(&ready) == n);
+    start = ktime_get_ns();
+    WRITE_ONCE(go, true);
+    wake_up_var(&go);
+    if (!ret)
+        msleep_interruptible(params.duration_ms);
+    WRITE_ONCE(stop, true);
+    r->elapsed_ns = ktime_get_ns() - start;
+
+    for (i = 0; i < n; i++)
+        kthread_stop_put(threads[i].task);
+    if (ret)
+        goto out;
+
+    r->ops = 0;
+    r->min_thread_ops = U64_MAX;
+    r->max_thread_ops = 0;
+    for (i = 0; i < n; i++) {
+        r->ops += threads[i].ops;
+        acquire_ns += threads[i].acquire_ns;
+        r->min_thread_ops = min(r->min_thread_ops, threads[i].ops);
+        r->max_thread_ops = max(r->max_thread_ops, threads[i].ops);
+    }
+    r->acquire_ns = r->ops ? div64_u64(acquire_ns, r->ops) : 0;
+    r->fairness = jain_fairness(threads, n, r->max_thread_ops);
+    r->reserved = 0;
+out:
+    kfree(threads);
+    return ret;
+}
+
+static void history_add(const struct lock_bench_run *run)
+{
+    mutex_lock(&history_lock);
+    history[history_next].params = run->params;
+    history[history_next].result = run->result;
+    history_next = (history_next + 1) % LOCK_BENCH_HISTORY;
+    history_len = min_t(unsigned int, history_len + 1, LOCK_BENCH_HISTORY);
+    mutex_unlock(&history_lock);
+}
+
+static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct lock_bench_run __user *urun = (struct lock_bench_run __user *)arg;
+    struct lock_bench_params *p;
+    struct lock_bench_run run;
+    int ret;
+
+    if (cmd != IOCTL_LOCK_BENCH_RUN)
+        return -ENOTTY;
+    // N kthreads spinning on one lock for up to a minute is not for everyone
+    if (!capable(CAP_SYS_ADMIN))
+        return -EPERM;
+    if (copy_from_user(&run.params, &urun->params, sizeof(run.params)))
+        return -EFAULT;
+
+    p = &run.params;
+    if (p->primitive >= LOCK_BENCH_NR_PRIMITIVES ||
+        !p->threads || p->threads > LOCK_BENCH_MAX_THREADS ||
+        !p->duration_ms || p->duration_ms > LOCK_BENCH_MAX_MS || p->read_pct > 100 ||
+        p->cs_loops > LOCK_BENCH_MAX_LOOPS || p->gap_loops > LOCK_BENCH_MAX_LOOPS)
+        return -EINVAL;
+
+    if (mutex_lock_interruptible(&run_lock))
+        return -EINTR;
+    ret = bench_run(&run);
+    mutex_unlock(&run_lock);
+    if (ret)
+        return ret;
+
+    pr_debug("%s x%u: %llu ops in %llu ns\n", primitive_names[p->primitive], p->threads,
+             run.result.ops, run.result.elapsed_ns);
+    history_add(&run);
+    if (copy_to_user(&urun->result, &run.result, sizeof(run.result)))
+        return -EFAULT;
+    return 0;
+}
+
+static int results_show(struct seq_file *m, void *v)
+{
+    unsigned int i;
+
+    seq_printf(m, "%-13s %7s %5s %6s %6s %12s %9s %10s %10s %10s %8s\n",
+               "primitive", "threads", "read%", "cs", "gap", "ops", "Mops/s",
+               "ns/acquire", "min_ops", "max_ops", "fairness");
+
+    mutex_lock(&history_lock);
+    for (i = 0; i < history_len; i++) {
+        // Oldest first
+        const struct bench_record *rec =
+            &history[(history_next + LOCK_BENCH_HISTORY - history_len + i) % LOCK_BENCH_HISTORY];
+        const struct lock_bench_result *r = &rec->result;
+        u64 mops_x100 = r->elapsed_ns ? div64_u64(r->ops * 100000, r->elapsed_ns) : 0;
+
+        seq_printf(m, "%-13s %7u %5u %6u %6u %12llu %6llu.%02llu %10llu %10llu %10llu %4u.%03u\n",
+                   primitive_names[rec->params.primitive], rec->params.threads,
+                   rec->params.read_pct, rec->params.cs_loops, rec->params.gap_loops,
+                   r->ops, mops_x100 / 100, mops_x100 % 100, r->acquire_ns,
+                   r->min_thread_ops, r->max_thread_ops,
+                   r->fairness / 1000, r->fairness % 1000);
+    }
+    mutex_unlock(&history_lock);
+    return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(results);
+
+static ssize_t reset_write(struct file *file, const char __user *buf, size_t len, loff_t *ppos)
+{
+    mutex_lock(&history_lock);
+    history_len = 0;
+    history_next = 0;
+    mutex_unlock(&history_lock);
+    return len;
+}
+
+static const struct file_operations reset_fops = {
+    .owner = THIS_MODULE,
+    .open = simple_open,
+    .write = reset_write,
+    .llseek = noop_llseek,
+};
+
+static struct file_operations fops = {
+    .owner = THIS_MODULE,
+    .unlocked_ioctl = dev_ioctl,
+};
+
+static int __init lock_bench_init(void)
+{
+    struct bench_copy *copy;
+    int ret;
+
+    copy = kzalloc(sizeof(*copy), GFP_KERNEL);
+    if (!copy)
+        return -ENOMEM;
+    RCU_INIT_POINTER(rcu_copy, copy);
+
+    ret = alloc_chrdev_region(&dev_num, 0, 1, DEVICE_NAME);
+    if (ret)
+        goto r_region;
+
+    cdev_init(&my_cdev, &fops);
+    ret = cdev_add(&my_cdev, dev_num, 1);
+    if (ret)
+        goto r_cdev;
+
+    dev_class = class_create(CLASS_NAME);
+    if (IS_ERR(dev_class)) {
+        ret = PTR_ERR(dev_class);
+        goto r_class;
+    }
+
+    dev_device = device_create(dev_class, NULL, dev_num, NULL, DEVICE_NAME);
+    if (IS_ERR(dev_device)) {
+        ret = PTR_ERR(dev_device);
+        goto r_device;
+    }
+
+    // debugfs failures are not fatal: the ioctl still returns every result
+    debug_dir = debugfs_create_dir(DEVICE_NAME, NULL);
+    debugfs_create_file("results", 0444, debug_dir, NULL, &results_fops);
+    debugfs_create_file("reset", 0200, debug_dir, NULL, &reset_fops);
+
+    pr_info("Lock benchmark loaded\n");
+    return 0;
+
+r_device:
+    class_destroy(dev_class);
+r_class:
+    cdev_del(&my_cdev);
+r_cdev:
+    unregister_chrdev_region(dev_num, 1);
+r_region:
+    kfree(copy);
+    return ret;
+}
+
+static void __exit lock_bench_exit(void)
+{
+    debugfs_remove_recursive(debug_dir);
+    device_destroy(dev_class, dev_num);
+    class_destroy(dev_class);
+    cdev_del(&my_cdev);
+    unregister_chrdev_region(dev_num, 1);
+    kfree(rcu_dereference_protected(rcu_copy, 1));
+    pr_info("Lock benchmark unloaded\n");
+}
+
+module_init(lock_bench_init);
+module_exit(lock_bench_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Lock contention benchmark: kthreads hammering one critical section");
@@ -0,0 +1,307 @@
+/* Tail read latency of high-priority readers of /dev/mutex_demo: mutex versus rt_mutex (pi=1).
+
+The classic priority inversion, all threads pinned to one CPU (-C):
+
+    readers  SCHED_FIFO 30  pread() every period_us and time it
+    hog      SCHED_FIFO 20  busy for burst_us, then sleeps idle_us
+    holder   SCHED_FIFO 10  IOCTL_LOCK, busy for hold_us, IOCTL_UNLOCK, sleeps gap_us
+    writers  SCHED_OTHER    pwrite() in a loop on any CPU (background contention)
+
+With a plain mutex, a reader that finds the holder owning my_mutex waits
+until the hog lets the holder run again: up to a whole burst. With the
+rt_mutex the reader lends the holder its priority and waits at most for
+the rest of hold_us. Reads use MUTEX_READ_MUTEX and ring mode is switched
+off, so every read takes my_mutex.
+
+The lock type is chosen when the module is loaded. By default the loaded
+module is measured as is (its mode comes from /sys/module/.../pi); with -k
+the harness reloads the given .ko with pi=0 and then pi=1 and prints both.
+Needs root (SCHED_FIFO, mlockall, insmod). The hog's duty cycle must stay
+under the RT throttling limit (95% by default).
+
+Build: gcc -O2 -pthread -o bench_mutex_pi bench_mutex_pi.c
+Usage: sudo ./bench_mutex_pi [-k dynamic_char_dev_ioctl_mutex.ko] [-C cpu] [-D seconds]
+                             [-r readers] [-p period_us] [-h hold_us] [-g gap_us]
+                             [-b burst_us] [-i idle_us] [-w writers]
+*/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include "../../include/uapi/chardev_ioctl.h"
+
+#define DEVICE_PATH "/dev/mutex_demo"
+#define MODULE_NAME "dynamic_char_dev_ioctl_mutex"
+#define PI_PARAM    "/sys/module/" MODULE_NAME "/parameters/pi"
+#define MAX_READERS 64
+
+enum { PRIO_HOLDER = 10, PRIO_HOG = 20, PRIO_READER = 30 };
+
+static int cpu, seconds = 5, nreaders = 1, nwriters = 2;
+static long period_us = 1000, hold_us = 200, gap_us = 800, burst_us = 5000, idle_us = 5000;
+static volatile int stop;
+static pthread_barrier_t start_barrier;
+
+struct reader {
+    pthread_t tid;
+    uint64_t *ns;           // one latency sample per read
+    size_t n, cap;
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void spin_us(long us) {
+    uint64_t end = now_ns() + us * 1000;
+
+    while (now_ns() < end)
+        ;
+}
+
+static int open_dev(void) {
+    int fd = open(DEVICE_PATH, O_RDWR);
+
+    if (fd < 0) {
+        perror(DEVICE_PATH);
+        exit(1);
+    }
+    return fd;
+}
+
+static void *reader_main(void *arg) {
+    struct reader *r = arg;
+    struct timespec next;
+    char buf[100];
+    int fd = open_dev();
+
+    pthread_barrier_wait(&start_barrier);
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!stop) {
+        uint64_t t0;
+
+        next.tv_nsec += period_us * 1000;
+        while (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        t0 = now_ns();
+        if (pread(fd, buf, sizeof(buf), 0) < 0) {
+            perror("reader pread");
+            exit(1);
+        }
+        if (r->n < r->cap)
+            r->ns[r->n++] = now_ns() - t0;
+    }
+    close(fd);
+    return NULL;
+}
+
+static void *hog_main(void *arg) {
+    pthread_barrier_wait(&start_barrier);
+    while (!stop) {
+        spin_us(burst_us);
+        usleep(idle_us);
+    }
+    return NULL;
+}
+
+static void *holder_main(void *arg) {
+    int fd = open_dev();
+
+    pthread_barrier_wait(&start_barrier);
+    while (!stop) {
+        if (ioctl(fd, IOCTL_LOCK) < 0) {
+            perror("IOCTL_LOCK");
+            exit(1);
+        }
+        spin_us(hold_us);
+        ioctl(fd, IOCTL_UNLOCK);
+        usleep(gap_us);
+    }
+    close(fd);
+    return NULL;
+}
+
+static void *writer_main(void *arg) {
+    const char msg[] = "background writer";
+    int fd = open_dev();
+
+    pthread_barrier_wait(&start_barrier);
+    while (!stop)
+        if (pwrite(fd, msg, sizeof(msg), 0) < 0) {
+            perror("writer pwrite");
+            exit(1);
+        }
+    close(fd);
+    return NULL;
+}
+
+// SCHED_FIFO @prio pinned to the test CPU, or SCHED_OTHER anywhere if @prio is 0
+static void start(pthread_t *tid, void *(*fn)(void *), void *arg, int prio) {
+    struct sched_param sp = { .sched_priority = prio };
+    pthread_attr_t attr;
+    cpu_set_t set;
+    int err;
+
+    pthread_attr_init(&attr);
+    if (prio) {
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &sp);
+    }
+    err = pthread_create(tid, &attr, fn, arg);
+    if (err) {
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+        exit(1);
+    }
+    pthread_attr_destroy(&attr);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int module_pi(void) {
+    FILE *f = fopen(PI_PARAM, "r");
+    int c = f ? fgetc(f) : EOF;
+
+    if (f)
+        fclose(f);
+    return c == 'Y' || c == '1';
+}
+
+static void load_module(const char *ko, int pi) {
+    char cmd[512];
+
+    if (system("rmmod " MODULE_NAME " 2>/dev/null") < 0)
+        perror("rmmod");
+    snprintf(cmd, sizeof(cmd), "insmod %s pi=%d", ko, pi);
+    if (system(cmd) != 0) {
+        fprintf(stderr, "%s failed\n", cmd);
+        exit(1);
+    }
+    // Give udev a moment to create the node
+    for (int i = 0; i < 200 && access(DEVICE_PATH, R_OK | W_OK); i++)
+        usleep(10000);
+}
+
+static void run(void) {
+    static struct reader r[MAX_READERS];
+    pthread_t hog, holder, writers[64];
+    uint64_t *all;
+    size_t n = 0, cap = (size_t)seconds * 1000000 / period_us + 1024;
+    int fd = open_dev(), zero = 0;
+
+    // Every read must take my_mutex
+    if (ioctl(fd, IOCTL_SET_READ_MODE, &zero) < 0 || ioctl(fd, IOCTL_SET_RING_MODE, &zero) < 0) {
+        perror("IOCTL_SET_READ_MODE/IOCTL_SET_RING_MODE");
+        exit(1);
+    }
+
+    stop = 0;
+    pthread_barrier_init(&start_barrier, NULL, nreaders + nwriters + 3);
+    for (int i = 0; i < nreaders; i++) {
+        r[i].n = 0;
+        r[i].cap = cap;
+        r[i].ns = malloc(cap * sizeof(*r[i].ns));
+        start(&r[i].tid, reader_main, &r[i], PRIO_READER);
+    }
+    start(&hog, hog_main, NULL, PRIO_HOG);
+    start(&holder, holder_main, NULL, PRIO_HOLDER);
+    for (int i = 0; i < nwriters; i++)
+        start(&writers[i], writer_main, NULL, 0);
+
+    pthread_barrier_wait(&start_barrier);
+    sleep(seconds);
+    stop = 1;
+
+    pthread_join(hog, NULL);
+    pthread_join(holder, NULL);
+    for (int i = 0; i < nwriters; i++)
+        pthread_join(writers[i], NULL);
+    all = malloc(nreaders * cap * sizeof(*all));
+    for (int i = 0; i < nreaders; i++) {
+        pthread_join(r[i].tid, NULL);
+        memcpy(all + n, r[i].ns, r[i].n * sizeof(*all));
+        n += r[i].n;
+        free(r[i].ns);
+    }
+    close(fd);
+
+    if (!n) {
+        printf("%-9s no reads completed\n", module_pi() ? "rt_mutex" : "mutex");
+    } else {
+        qsort(all, n, sizeof(*all), cmp_u64);
+        printf("%-9s %10zu %10.1f %10.1f %10.1f %10.1f\n", module_pi() ? "rt_mutex" : "mutex", n,
+               all[n / 2] / 1e3, all[(size_t)((n - 1) * 0.99)] / 1e3,
+               all[(size_t)((n - 1) * 0.999)] / 1e3, all[n - 1] / 1e3);
+    }
+    free(all);
+}
+
+int main(int argc, char *argv[]) {
+    const char *ko = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "k:C:D:r:p:h:g:b:i:w:")) != -1) {
+        switch (opt) {
+        case 'k': ko = optarg; break;
+        case 'C': cpu = atoi(optarg); break;
+        case 'D': seconds = atoi(optarg); break;
+        case 'r': nreaders = atoi(optarg); break;
+        case 'p': period_us = atol(optarg); break;
+        case 'h': hold_us = atol(optarg); break;
+        case 'g': gap_us = atol(optarg); break;
+        case 'b': burst_us = atol(optarg); break;
+        case 'i': idle_us = atol(optarg); break;
+        case 'w': nwriters = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-k module.ko] [-C cpu] [-D seconds] [-r readers] "
+                    "[-p period_us] [-h hold_us] [-g gap_us] [-b burst_us] [-i idle_us] "
+                    "[-w writers]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (nreaders < 1 || nreaders > MAX_READERS || nwriters < 0 || nwriters > 64 ||
+        seconds < 1 || period_us < 1) {
+        fprintf(stderr, "need 1..%d readers, 0..64 writers, seconds and period_us >= 1\n",
+                MAX_READERS);
+        return 1;
+    }
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        perror("mlockall");
+
+    printf("CPU %d: read every %ld us, hold %ld us every %ld us, hog %ld/%ld us busy/idle, "
+           "%d writers, %d s\n", cpu, period_us, hold_us, hold_us + gap_us, burst_us,
+           burst_us + idle_us, nwriters, seconds);
+    printf("%-9s %10s %10s %10s %10s %10s   (read latency, us)\n", "lock", "reads", "p50", "p99",
+           "p99.9", "max");
+    if (!ko) {
+        run();
+        return 0;
+    }
+    load_module(ko, 0);
+    run();
+    load_module(ko, 1);
+    run();
+    return 0;
+}
@@ -0,0 +1,177 @@
+/* Read throughput of /dev/mutex_demo versus reader thread count for each read mode
+(IOCTL_SET_READ_MODE): mutex, seqcount and RCU.
+
+Every reader has its own fd and loops pread() of the whole 100-byte buffer.
+With -w a writer thread rewrites the buffer every given number of
+microseconds, so the lockless modes also pay for their retries and copies;
+each read must then still return one of the two strings the writer
+alternates between, anything else is counted as torn.
+
+Build: gcc -O2 -pthread -o bench_mutex_read bench_mutex_read.c
+Usage: ./bench_mutex_read [-d device] [-t max_threads] [-s seconds] [-w writer_us]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include "../../include/uapi/chardev_ioctl.h"
+
+#define DEFAULT_DEVICE "/dev/mutex_demo"
+#define MAX_THREADS    256
+#define BUF_SIZE       100
+
+static const char *device = DEFAULT_DEVICE;
+static const char *const payload[2] = { "first payload string", "SECOND PAYLOAD STRING" };
+static double seconds = 2.0;
+static long writer_us = -1;
+static volatile int stop;
+
+struct reader {
+    pthread_t tid;
+    unsigned long reads;
+    unsigned long torn;
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int open_dev(void) {
+    int fd = open(device, O_RDWR);
+
+    if (fd < 0) {
+        perror("open device");
+        exit(1);
+    }
+    return fd;
+}
+
+static void *reader(void *arg) {
+    struct reader *r = arg;
+    char buf[BUF_SIZE];
+    int fd = open_dev();
+
+    while (!stop) {
+        if (pread(fd, buf, sizeof(buf), 0) != sizeof(buf)) {
+            perror("pread");
+            exit(1);
+        }
+        if (writer_us >= 0 && strcmp(buf, payload[0]) && strcmp(buf, payload[1]))
+            r->torn++;
+        r->reads++;
+    }
+    close(fd);
+    return NULL;
+}
+
+static void *writer(void *arg) {
+    int fd = open_dev();
+
+    (void)arg;
+    for (unsigned long k = 0; !stop; k++) {
+        const char *s = payload[k & 1];
+
+        if (pwrite(fd, s, strlen(s) + 1, 0) < 0) {
+            perror("pwrite");
+            exit(1);
+        }
+        if (writer_us)
+            usleep(writer_us);
+    }
+    close(fd);
+    return NULL;
+}
+
+// 1, 2, 4 ... and finally max itself
+static int next_threads(int t, int max) {
+    return t < max && t * 2 > max ? max : t * 2;
+}
+
+static void run(const char *mode, int nthreads) {
+    struct reader r[MAX_THREADS] = { 0 };
+    unsigned long reads = 0, torn = 0;
+    pthread_t wtid;
+    double start, elapsed;
+
+    stop = 0;
+    if (writer_us >= 0 && pthread_create(&wtid, NULL, writer, NULL)) {
+        perror("pthread_create");
+        exit(1);
+    }
+    start = now_sec();
+    for (int i = 0; i < nthreads; i++) {
+        if (pthread_create(&r[i].tid, NULL, reader, &r[i])) {
+            perror("pthread_create");
+            exit(1);
+        }
+    }
+    usleep(seconds * 1e6);
+    stop = 1;
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(r[i].tid, NULL);
+        reads += r[i].reads;
+        torn += r[i].torn;
+    }
+    elapsed = now_sec() - start;
+    if (writer_us >= 0)
+        pthread_join(wtid, NULL);
+
+    printf("%-10s %8d %14.0f %14.0f %8lu\n", mode, nthreads, reads / elapsed,
+           reads / elapsed / nthreads, torn);
+}
+
+int main(int argc, char *argv[]) {
+    static const struct { const char *name; int mode; } modes[] = {
+        { "mutex",    MUTEX_READ_MUTEX },
+        { "seqcount", MUTEX_READ_SEQCOUNT },
+        { "rcu",      MUTEX_READ_RCU },
+    };
+    int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int fd, opt;
+
+    while ((opt = getopt(argc, argv, "d:t:s:w:")) != -1) {
+        switch (opt) {
+        case 'd': device = optarg; break;
+        case 't': max_threads = atoi(optarg); break;
+        case 's': seconds = atof(optarg); break;
+        case 'w': writer_us = atol(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-d device] [-t max_threads] [-s seconds] [-w writer_us]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (max_threads < 1 || max_threads > MAX_THREADS) {
+        fprintf(stderr, "need 1..%d threads\n", MAX_THREADS);
+        return 1;
+    }
+
+    fd = open_dev();
+    if (pwrite(fd, payload[0], strlen(payload[0]) + 1, 0) < 0) {
+        perror("pwrite");
+        return 1;
+    }
+
+    printf("%-10s %8s %14s %14s %8s\n", "mode", "readers", "reads/s", "reads/s/thread", "torn");
+    for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        int mode = modes[m].mode;
+
+        if (ioctl(fd, IOCTL_SET_READ_MODE, &mode) < 0) {
+            perror("IOCTL_SET_READ_MODE");
+            return 1;
+        }
+        for (int t = 1; t <= max_threads; t = next_threads(t, max_threads))
+            run(modes[m].name, t);
+    }
+
+    opt = MUTEX_READ_MUTEX;
+    ioctl(fd, IOCTL_SET_READ_MODE, &opt);
+    close(fd);
+    return 0;
+}
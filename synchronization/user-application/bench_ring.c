@@ -0,0 +1,229 @@
+/* Compares the locked shared buffer of mutex_demo / sem_variants with their lockless rings.
+
+For each mode the device is switched to it (IOCTL_SET_RING_MODE or
+SEM_IOCTL_SET_RING) and producer threads write fixed-size messages while
+consumer threads read them, each on its own O_NONBLOCK fd, for the run
+time. Full and empty rings are counted instead of slept on, so the table
+shows the raw cost of the path:
+
+    locked  every write overwrites the shared buffer and every read copies it
+            under the driver's lock (mutex, or the semaphore's slot pool)
+    spsc    kfifo ring; always one producer and one consumer
+    mpmc    per-slot sequence ring with -p producers and -c consumers
+
+Each message carries its producer and a sequence number. In the ring modes
+a consumer must see every producer's messages in order (consecutively for
+spsc), and after the run the messages read plus those left in the ring must
+add up to the messages written; otherwise the run is flagged.
+
+Build: gcc -O2 -pthread -o bench_ring bench_ring.c
+Usage: sudo ./bench_ring [-d mutex|sem] [-p producers] [-c consumers] [-s 16|32|64] [-D ms]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include "../../include/uapi/chardev_ioctl.h"
+
+#define MAX_THREADS 256
+
+struct msg {
+    uint32_t producer;
+    uint32_t reserved;
+    uint64_t seq;
+};
+
+struct worker {
+    pthread_t tid;
+    int fd;
+    int id;
+    uint64_t ops, waits, bad;       // messages, EAGAINs, order violations
+} __attribute__((aligned(64)));
+
+static const char *dev_path = "/dev/mutex_demo";
+static unsigned long set_ring_cmd = IOCTL_SET_RING_MODE;
+static int mode, nproducers, msg_size = 64;
+static volatile int stop;
+static pthread_barrier_t start_barrier;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *producer_main(void *arg) {
+    struct worker *w = arg;
+    char buf[RING_MSG_MAX] = { 0 };
+    struct msg *m = (struct msg *)buf;
+
+    m->producer = w->id;
+    pthread_barrier_wait(&start_barrier);
+    while (!stop) {
+        ssize_t n = mode == RING_MODE_OFF ? pwrite(w->fd, buf, msg_size, 0)
+                                          : write(w->fd, buf, msg_size);
+        if (n == msg_size) {
+            m->seq++;
+            w->ops++;
+        } else if (n < 0 && errno == EAGAIN) {
+            w->waits++;
+        } else {
+            perror("producer write");
+            exit(1);
+        }
+    }
+    return NULL;
+}
+
+static void *consumer_main(void *arg) {
+    struct worker *w = arg;
+    char buf[RING_MSG_MAX];
+    struct msg *m = (struct msg *)buf;
+    int64_t *last = calloc(nproducers, sizeof(*last));
+
+    for (int i = 0; i < nproducers; i++)
+        last[i] = -1;
+    pthread_barrier_wait(&start_barrier);
+    while (!stop) {
+        ssize_t n = mode == RING_MODE_OFF ? pread(w->fd, buf, msg_size, 0)
+                                          : read(w->fd, buf, msg_size);
+        if (n < 0 && errno == EAGAIN) {
+            w->waits++;
+            continue;
+        }
+        if (n != msg_size) {
+            perror("consumer read");
+            exit(1);
+        }
+        w->ops++;
+        if (mode == RING_MODE_OFF)
+            continue;
+        if (m->producer >= (uint32_t)nproducers || (int64_t)m->seq <= last[m->producer] ||
+            (mode == RING_MODE_SPSC && (int64_t)m->seq != last[m->producer] + 1))
+            w->bad++;
+        else
+            last[m->producer] = m->seq;
+    }
+    free(last);
+    return NULL;
+}
+
+// Messages left in the ring; also empties it for the next run
+static uint64_t drain(int fd) {
+    char buf[RING_MSG_MAX];
+    uint64_t left = 0;
+
+    while (read(fd, buf, msg_size) == msg_size)
+        left++;
+    return left;
+}
+
+static void run(int ctl, const char *name, int np, int nc, int ms) {
+    static struct worker w[2 * MAX_THREADS];
+    uint64_t written = 0, read_ = 0, full = 0, empty = 0, bad = 0, left = 0;
+    double start, elapsed;
+    const char *check;
+
+    mode = !strcmp(name, "spsc") ? RING_MODE_SPSC : !strcmp(name, "mpmc") ? RING_MODE_MPMC
+                                                                            : RING_MODE_OFF;
+    nproducers = np;
+    if (ioctl(ctl, set_ring_cmd, &mode) < 0) {
+        perror("set ring mode");
+        exit(1);
+    }
+    if (mode != RING_MODE_OFF)
+        drain(ctl);
+
+    stop = 0;
+    memset(w, 0, sizeof(w));
+    pthread_barrier_init(&start_barrier, NULL, np + nc + 1);
+    for (int i = 0; i < np + nc; i++) {
+        w[i].id = i < np ? i : i - np;
+        w[i].fd = open(dev_path, O_RDWR | O_NONBLOCK);
+        if (w[i].fd < 0 ||
+            pthread_create(&w[i].tid, NULL, i < np ? producer_main : consumer_main, &w[i])) {
+            perror("worker setup");
+            exit(1);
+        }
+    }
+    pthread_barrier_wait(&start_barrier);
+    start = now_sec();
+    usleep(ms * 1000);
+    stop = 1;
+    for (int i = 0; i < np + nc; i++) {
+        pthread_join(w[i].tid, NULL);
+        close(w[i].fd);
+        if (i < np) {
+            written += w[i].ops;
+            full += w[i].waits;
+        } else {
+            read_ += w[i].ops;
+            empty += w[i].waits;
+            bad += w[i].bad;
+        }
+    }
+    elapsed = now_sec() - start;
+    pthread_barrier_destroy(&start_barrier);
+
+    if (mode == RING_MODE_OFF) {
+        check = "-";
+    } else {
+        left = drain(ctl);
+        check = bad ? "ORDER" : read_ + left != written ? "LOST" : "ok";
+    }
+    printf("%-7s %4d %4d %14.0f %14.0f %12llu %12llu  %s\n", name, np, nc, written / elapsed,
+           read_ / elapsed, (unsigned long long)full, (unsigned long long)empty, check);
+}
+
+int main(int argc, char *argv[]) {
+    int np = 4, nc = 4, ms = 1000, ctl, opt;
+
+    while ((opt = getopt(argc, argv, "d:p:c:s:D:")) != -1) {
+        switch (opt) {
+        case 'd':
+            if (!strcmp(optarg, "sem")) {
+                dev_path = "/dev/sem_variants";
+                set_ring_cmd = SEM_IOCTL_SET_RING;
+            }
+            break;
+        case 'p': np = atoi(optarg); break;
+        case 'c': nc = atoi(optarg); break;
+        case 's': msg_size = atoi(optarg); break;
+        case 'D': ms = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-d mutex|sem] [-p producers] [-c consumers] "
+                    "[-s 16|32|64] [-D ms]\n", argv[0]);
+            return 1;
+        }
+    }
+    // spsc is a byte stream: power-of-two messages never straddle a partial write
+    if (np < 1 || np > MAX_THREADS || nc < 1 || nc > MAX_THREADS ||
+        (msg_size != 16 && msg_size != 32 && msg_size != 64)) {
+        fprintf(stderr, "need 1..%d producers and consumers, and -s 16, 32 or 64\n", MAX_THREADS);
+        return 1;
+    }
+
+    ctl = open(dev_path, O_RDWR | O_NONBLOCK);
+    if (ctl < 0) {
+        perror(dev_path);
+        return 1;
+    }
+
+    printf("%s, %d-byte messages, %d ms per mode\n", dev_path, msg_size, ms);
+    printf("%-7s %4s %4s %14s %14s %12s %12s  %s\n", "mode", "prod", "cons", "writes/s",
+           "reads/s", "full", "empty", "check");
+    run(ctl, "locked", np, nc, ms);
+    run(ctl, "spsc", 1, 1, ms);
+    run(ctl, "mpmc", np, nc, ms);
+
+    opt = RING_MODE_OFF;
+    ioctl(ctl, set_ring_cmd, &opt);
+    close(ctl);
+    return 0;
+}
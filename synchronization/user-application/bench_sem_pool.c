@@ -0,0 +1,156 @@
+/* Sweeps the /dev/sem_variants slot pool size under a fixed number of contending threads.
+
+For each pool size (SEM_IOCTL_SET_SLOTS) every thread opens its own fd, sets
+the acquire policy and loops pread() (or pwrite() with -W) for the run time.
+The table shows completed accesses per second and how many failed with
+EBUSY (trylock), ETIME (timeout) or anything else. Per-acquire wait and
+hold times and the top contenders are in /sys/kernel/debug/sem_variants/
+locks/sem, failures by kind in .../acquire; both are cleared before each
+pool size, so afterwards they describe the last one (use -n with a single
+size to look at a particular one).
+
+Build: gcc -O2 -pthread -o bench_sem_pool bench_sem_pool.c
+Usage: sudo ./bench_sem_pool [-t threads] [-n 1,2,4,8] [-p policy] [-T timeout_ms]
+                             [-h hold_us] [-D ms] [-W]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include "../../include/uapi/chardev_ioctl.h"
+
+#define DEVICE_PATH  "/dev/sem_variants"
+#define ACQ_RESET    "/sys/kernel/debug/sem_variants/acquire_reset"
+#define LOCK_STATS   "/sys/kernel/debug/sem_variants/locks/sem"
+#define MAX_THREADS  1024
+
+static const char *const policies[] = { "down", "interruptible", "killable", "trylock", "timeout" };
+static struct sem_policy pol = { .policy = SEM_POLICY_DOWN, .timeout_ms = 10 };
+static int do_write;
+static volatile int stop;
+
+struct worker {
+    pthread_t tid;
+    unsigned long ok, busy, timeouts, other;
+};
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    char buf[100] = "bench_sem_pool";
+    int fd = open(DEVICE_PATH, O_RDWR);
+
+    if (fd < 0 || ioctl(fd, SEM_IOCTL_SET_POLICY, &pol) < 0) {
+        perror("worker setup");
+        exit(1);
+    }
+    while (!stop) {
+        ssize_t n = do_write ? pwrite(fd, buf, sizeof(buf), 0) : pread(fd, buf, sizeof(buf), 0);
+
+        if (n >= 0)
+            w->ok++;
+        else if (errno == EBUSY)
+            w->busy++;
+        else if (errno == ETIME)
+            w->timeouts++;
+        else
+            w->other++;
+    }
+    close(fd);
+    return NULL;
+}
+
+static void reset_file(const char *path) {
+    int fd = open(path, O_WRONLY);
+
+    if (fd >= 0) {
+        if (write(fd, "1", 1) < 0)
+            perror(path);
+        close(fd);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    static struct worker w[MAX_THREADS];
+    int sizes[64] = { 1, 2, 4, 8 }, nsizes = 4, nthreads = 16, ms = 1000;
+    int fd, opt;
+
+    while ((opt = getopt(argc, argv, "t:n:p:T:h:D:W")) != -1) {
+        switch (opt) {
+        case 't': nthreads = atoi(optarg); break;
+        case 'n':
+            nsizes = 0;
+            for (char *tok = strtok(optarg, ","); tok && nsizes < 64; tok = strtok(NULL, ","))
+                if ((sizes[nsizes] = atoi(tok)) > 0)
+                    nsizes++;
+            break;
+        case 'p':
+            for (pol.policy = 0; pol.policy < 5 && strcmp(optarg, policies[pol.policy]); pol.policy++)
+                ;
+            break;
+        case 'T': pol.timeout_ms = atoi(optarg); break;
+        case 'h': pol.hold_us = atoi(optarg); break;
+        case 'D': ms = atoi(optarg); break;
+        case 'W': do_write = 1; break;
+        default:
+            fprintf(stderr, "Usage: %s [-t threads] [-n 1,2,4,8] [-p policy] [-T timeout_ms] "
+                    "[-h hold_us] [-D ms] [-W]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (nthreads < 1 || nthreads > MAX_THREADS || pol.policy >= 5) {
+        fprintf(stderr, "need 1..%d threads and one of: down interruptible killable trylock timeout\n",
+                MAX_THREADS);
+        return 1;
+    }
+
+    fd = open(DEVICE_PATH, O_RDWR);
+    if (fd < 0) {
+        perror("open " DEVICE_PATH);
+        return 1;
+    }
+
+    printf("%d threads, policy %s, hold %u us, %s\n", nthreads, policies[pol.policy], pol.hold_us,
+           do_write ? "writes" : "reads");
+    printf("%6s %14s %10s %10s %10s\n", "slots", "accesses/s", "busy", "timeouts", "other");
+    for (int s = 0; s < nsizes; s++) {
+        unsigned long ok = 0, busy = 0, timeouts = 0, other = 0;
+        double start, elapsed;
+
+        if (ioctl(fd, SEM_IOCTL_SET_SLOTS, &sizes[s]) < 0) {
+            perror("SEM_IOCTL_SET_SLOTS");
+            return 1;
+        }
+        reset_file(ACQ_RESET);
+        reset_file(LOCK_STATS);
+        stop = 0;
+        memset(w, 0, nthreads * sizeof(w[0]));
+        start = now_sec();
+        for (int i = 0; i < nthreads; i++)
+            pthread_create(&w[i].tid, NULL, worker_main, &w[i]);
+        usleep(ms * 1000);
+        stop = 1;
+        for (int i = 0; i < nthreads; i++) {
+            pthread_join(w[i].tid, NULL);
+            ok += w[i].ok;
+            busy += w[i].busy;
+            timeouts += w[i].timeouts;
+            other += w[i].other;
+        }
+        elapsed = now_sec() - start;
+        printf("%6d %14.0f %10lu %10lu %10lu\n", sizes[s], ok / elapsed, busy, timeouts, other);
+    }
+
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,111 @@
+/* Drives the lock_bench module: sweeps primitives and thread counts and prints CSV.
+
+For every primitive (or only the -p one) and 1, 2, 4 ... max threads it
+issues one IOCTL_LOCK_BENCH_RUN and prints a line with the throughput, the
+mean ns per acquisition, the per-thread min/max acquisitions and Jain's
+fairness index (1.000 = every thread got the same share). The same runs
+are kept in /sys/kernel/debug/lock_bench/results.
+
+Build: gcc -O2 -o run_lock_bench run_lock_bench.c
+Usage: sudo ./run_lock_bench [-p primitive] [-t max_threads] [-D ms] [-c cs_loops]
+                             [-g gap_loops] [-r read_pct]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "../../include/uapi/chardev_ioctl.h"
+
+#define DEVICE_PATH "/dev/lock_bench"
+
+static const char *const names[LOCK_BENCH_NR_PRIMITIVES] = {
+    [LOCK_BENCH_SPINLOCK]       = "spinlock",
+    [LOCK_BENCH_MUTEX]          = "mutex",
+    [LOCK_BENCH_SEMAPHORE]      = "semaphore",
+    [LOCK_BENCH_RWSEM]          = "rwsem",
+    [LOCK_BENCH_RWLOCK]         = "rwlock",
+    [LOCK_BENCH_SEQLOCK]        = "seqlock",
+    [LOCK_BENCH_PERCPU_RWSEM]   = "percpu_rwsem",
+    [LOCK_BENCH_RCU]            = "rcu",
+};
+
+// 1, 2, 4 ... and finally max itself
+static int next_threads(int t, int max) {
+    return t < max && t * 2 > max ? max : t * 2;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-p primitive] [-t max_threads] [-D ms] [-c cs_loops] "
+            "[-g gap_loops] [-r read_pct]\nprimitives:", prog);
+    for (int i = 0; i < LOCK_BENCH_NR_PRIMITIVES; i++)
+        fprintf(stderr, " %s", names[i]);
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[]) {
+    struct lock_bench_params p = {
+        .duration_ms = 1000,
+        .cs_loops = 16,
+        .gap_loops = 64,
+        .read_pct = 90,
+    };
+    int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    int only = -1, fd, opt;
+
+    while ((opt = getopt(argc, argv, "p:t:D:c:g:r:")) != -1) {
+        switch (opt) {
+        case 'p':
+            for (only = 0; only < LOCK_BENCH_NR_PRIMITIVES; only++)
+                if (!strcmp(optarg, names[only]))
+                    break;
+            if (only == LOCK_BENCH_NR_PRIMITIVES)
+                usage(argv[0]);
+            break;
+        case 't': max_threads = atoi(optarg); break;
+        case 'D': p.duration_ms = strtoul(optarg, NULL, 0); break;
+        case 'c': p.cs_loops = strtoul(optarg, NULL, 0); break;
+        case 'g': p.gap_loops = strtoul(optarg, NULL, 0); break;
+        case 'r': p.read_pct = strtoul(optarg, NULL, 0); break;
+        default: usage(argv[0]);
+        }
+    }
+    if (max_threads < 1 || p.cs_loops > LOCK_BENCH_MAX_LOOPS || p.gap_loops > LOCK_BENCH_MAX_LOOPS)
+        usage(argv[0]);
+
+    fd = open(DEVICE_PATH, O_RDWR);
+    if (fd < 0) {
+        perror("open " DEVICE_PATH);
+        return 1;
+    }
+
+    printf("primitive,threads,read_pct,cs_loops,gap_loops,ops,mops_per_s,ns_per_acquire,"
+           "min_thread_ops,max_thread_ops,fairness\n");
+    for (int prim = 0; prim < LOCK_BENCH_NR_PRIMITIVES; prim++) {
+        if (only >= 0 && prim != only)
+            continue;
+        for (int t = 1; t <= max_threads; t = next_threads(t, max_threads)) {
+            struct lock_bench_run run = { .params = p };
+            const struct lock_bench_result *r = &run.result;
+
+            run.params.primitive = prim;
+            run.params.threads = t;
+            if (ioctl(fd, IOCTL_LOCK_BENCH_RUN, &run) < 0) {
+                perror("IOCTL_LOCK_BENCH_RUN");
+                return 1;
+            }
+            printf("%s,%d,%u,%u,%u,%llu,%.2f,%llu,%llu,%llu,%.3f\n", names[prim], t,
+                   p.read_pct, p.cs_loops, p.gap_loops, (unsigned long long)r->ops,
+                   r->elapsed_ns ? r->ops * 1e3 / r->elapsed_ns : 0.0,
+                   (unsigned long long)r->acquire_ns,
+                   (unsigned long long)r->min_thread_ops,
+                   (unsigned long long)r->max_thread_ops, r->fairness / 1000.0);
+            fflush(stdout);
+        }
+    }
+
+    close(fd);
+    return 0;
+}
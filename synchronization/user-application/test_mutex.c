@@ -5,20 +5,14 @@
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <string.h>
+#include "../../include/uapi/chardev_ioctl.h"
 
 #define DEVICE_PATH "/dev/mutex_demo"
 
-#define IOCTL_MUTEX_LOCK            _IO('M', 1)
-#define IOCTL_MUTEX_LOCK_INTERRUPTIBLE _IO('M', 2)
-#define IOCTL_MUTEX_LOCK_KILLABLE   _IO('M', 3)
-#define IOCTL_MUTEX_TRYLOCK         _IO('M', 4)
-#define IOCTL_MUTEX_IS_LOCKED       _IOR('M', 5, int)
-#define IOCTL_MUTEX_UNLOCK          _IO('M', 6)
-
 void perform_ioctl(int fd, unsigned int cmd, const char *cmd_name) {
     printf("\nInvoking IOCTL: %s\n", cmd_name);
 
-    if (cmd == IOCTL_MUTEX_IS_LOCKED) {
+    if (cmd == IOCTL_IS_LOCKED) {
         int is_locked = -1;
         if (ioctl(fd, cmd, &is_locked) < 0) {
             perror("ioctl - mutex_is_locked");
@@ -47,25 +41,25 @@ int main() {
     }
 
     // Call each IOCTL one by one
-    perform_ioctl(fd, IOCTL_MUTEX_LOCK, "mutex_lock");
-    perform_ioctl(fd, IOCTL_MUTEX_IS_LOCKED, "mutex_is_locked");
-    perform_ioctl(fd, IOCTL_MUTEX_UNLOCK, "mutex_unlock");
+    perform_ioctl(fd, IOCTL_LOCK, "mutex_lock");
+    perform_ioctl(fd, IOCTL_IS_LOCKED, "mutex_is_locked");
+    perform_ioctl(fd, IOCTL_UNLOCK, "mutex_unlock");
 
     printf("10 seconds delay\n");
     sleep(20);
-    printf("IOCTL_MUTEX_LOCK_INTERRUPTIBLE started \n");
-    perform_ioctl(fd, IOCTL_MUTEX_LOCK_INTERRUPTIBLE, "mutex_lock_interruptible");
-    perform_ioctl(fd, IOCTL_MUTEX_UNLOCK, "mutex_unlock");
+    printf("IOCTL_LOCK_INTERRUPTIBLE started \n");
+    perform_ioctl(fd, IOCTL_LOCK_INTERRUPTIBLE, "mutex_lock_interruptible");
+    perform_ioctl(fd, IOCTL_UNLOCK, "mutex_unlock");
 
     printf("10 seconds delay\n");
     sleep(20);
-    printf("IOCTL_MUTEX_LOCK_KILLABLE started \n");
-    perform_ioctl(fd, IOCTL_MUTEX_LOCK_KILLABLE, "mutex_lock_killable");
-    perform_ioctl(fd, IOCTL_MUTEX_UNLOCK, "mutex_unlock");
+    printf("IOCTL_LOCK_KILLABLE started \n");
+    perform_ioctl(fd, IOCTL_LOCK_KILLABLE, "mutex_lock_killable");
+    perform_ioctl(fd, IOCTL_UNLOCK, "mutex_unlock");
 
-    perform_ioctl(fd, IOCTL_MUTEX_TRYLOCK, "mutex_trylock");
-    perform_ioctl(fd, IOCTL_MUTEX_IS_LOCKED, "mutex_is_locked");
-    perform_ioctl(fd, IOCTL_MUTEX_UNLOCK, "mutex_unlock");
+    perform_ioctl(fd, IOCTL_TRYLOCK, "mutex_trylock");
+    perform_ioctl(fd, IOCTL_IS_LOCKED, "mutex_is_locked");
+    perform_ioctl(fd, IOCTL_UNLOCK, "mutex_unlock");
 
     close(fd);
     return 0;
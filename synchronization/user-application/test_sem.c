@@ -6,14 +6,33 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <sys/ioctl.h>
+#include "../../include/uapi/chardev_ioctl.h"
+
+// Usage: ./test_sem [down|interruptible|killable|trylock|timeout] [hold_us]
+int main(int argc, char *argv[]) {
+    static const char *const policies[] = { "down", "interruptible", "killable", "trylock", "timeout" };
+    struct sem_policy pol = { .policy = SEM_POLICY_INTERRUPTIBLE, .timeout_ms = 1000 };
 
-int main() {
     int fd = open("/dev/sem_variants", O_RDWR);
     if (fd < 0) {
         perror("open");
         return 1;
     }
 
+    if (argc > 1) {
+        for (pol.policy = 0; pol.policy < 5 && strcmp(argv[1], policies[pol.policy]); pol.policy++)
+            ;
+        if (argc > 2)
+            pol.hold_us = strtoul(argv[2], NULL, 0);
+        if (ioctl(fd, SEM_IOCTL_SET_POLICY, &pol) < 0) {
+            perror("SEM_IOCTL_SET_POLICY");
+            close(fd);
+            return 1;
+        }
+        printf("Policy %s, holding for %u us\n", argv[1], pol.hold_us);
+    }
+
     // Write something
     const char *msg = "Critical Code";
     if (write(fd, msg, strlen(msg)) < 0) {
@@ -2,12 +2,9 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include "../../include/uapi/chardev_ioctl.h"
 
 #define DEVICE "/dev/spinlock_dev"
-#define SPIN_LOCK         _IO(0xF0, 1)
-#define SPIN_LOCK_IRQSAVE _IO(0xF0, 2)
-#define SPIN_LOCK_IRQ     _IO(0xF0, 3)
-#define SPIN_LOCK_BH      _IO(0xF0, 4)
 
 int main() {
     int fd = open(DEVICE, O_RDWR);
@@ -28,6 +25,11 @@ int main() {
     printf("Triggering spin_lock_bh...\n");
     ioctl(fd, SPIN_LOCK_BH);
 
+    struct spin_total total;
+    if (ioctl(fd, SPIN_READ_TOTAL, &total) == 0)
+        printf("Counter: %llu after %llu updates\n",
+               (unsigned long long)total.sum, (unsigned long long)total.updates);
+
     close(fd);
     return 0;
 }
\ No newline at end of file